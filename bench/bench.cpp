@@ -0,0 +1,341 @@
+/*
+Headless benchmark for the software renderer.
+
+Runs a fixed set of workloads through every blit backend the CPU supports, reports how long they take,
+and checks what they drew against known-good checksums, so a change to any of the backends can be proven
+to still be bit-exact. Nothing here touches SDL or GL, so it runs fine on a machine without a GPU.
+
+usage: bench [iterations] [--update]
+    --update prints the checksums of the current output as a new golden table instead of checking against it
+
+NOTE: run it from the repo root, since it loads the game's font from res/
+NOTE: the goldens are the scalar backend's output, and every backend is held to them. if a change to the
+      renderer is *supposed* to change the output, rerun with --update and paste the new hashes into the table below
+*/
+
+#include "pixel.hpp"
+#include "canvas8.hpp"
+#include "trace.hpp"
+
+//same size as the game's canvas, so the numbers mean something for the real thing
+const int canvasWidth = 540;
+const int canvasHeight = 400;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// ASSETS                                                                                                           ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//xorshift, reseeded before every run so each workload draws exactly the same thing every time
+static u32 rngState;
+static inline u32 rng_u32() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+static inline int rng_int(int lo, int hi) { return lo + rng_u32() % (hi - lo); }
+static inline Color rng_color(u8 alpha) { return { (u8) rng_u32(), (u8) rng_u32(), (u8) rng_u32(), alpha }; }
+
+//procedural images, so nothing but the font depends on files that might change
+static Image make_test_image(int width, int height, bool soft) {
+    Image image = { (Pixel *) malloc(width * height * sizeof(Pixel)), width, height, width };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            //a disc with either a hard or a feathered edge, over a fully transparent background
+            float dx = (x + 0.5f) / width * 2 - 1, dy = (y + 0.5f) / height * 2 - 1;
+            float d = sqrtf(dx * dx + dy * dy);
+            int a = soft? fmaxf(0, fminf(1, (1 - d) * 2)) * 255 : (d < 1) * 255;
+            Color c = { (u8) (x * 255 / width), (u8) (y * 255 / height), (u8) ((x ^ y) * 4), (u8) a };
+            image[y][x] = premultiply(c);
+        }
+    }
+    return image;
+}
+
+static Image make_opaque_image(int width, int height) {
+    Image image = { (Pixel *) malloc(width * height * sizeof(Pixel)), width, height, width };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            image[y][x] = { (u8) (x * 3 + y), (u8) (y * 5), (u8) ((x / 8 + y / 8) % 2 * 128), 255 };
+        }
+    }
+    return image;
+}
+
+struct Assets {
+    MonoFont font;
+    Image background; //canvas-sized, fully opaque
+    Image overlay; //canvas-sized, soft alpha everywhere
+    Image small; //16x16 with a feathered edge
+    Image texture; //64x64 with a hard edge
+
+    Palette palette; //a couple dozen colors, like the game's terminal art
+    Canvas8 indexed; //canvas-sized
+    Image8 texture8; //the texture above, quantized into the palette
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// WORKLOADS                                                                                                        ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//what one frame of a workload did, for turning the time it took into per-call and per-pixel numbers
+//NOTE: pixels are counted by the nominal size of each draw, before clipping
+struct Work {
+    int calls;
+    i64 pixels;
+};
+
+//a full screen of terminal text, like the game draws every frame
+static Work text_frame(Canvas & canvas, Assets & assets) {
+    Work work = {};
+    fill_rect(canvas, 0, 0, canvas.width, canvas.height, { 0, 0, 0, 255 });
+    work.calls += 1;
+    work.pixels += canvas.width * canvas.height;
+
+    char line[128];
+    int columns = canvas.width / assets.font.glyphWidth;
+    for (int y = 0; y < canvas.height; y += assets.font.glyphHeight) {
+        for (int i = 0; i < columns; ++i) {
+            line[i] = rng_int(' ', '~' + 1);
+        }
+        line[columns] = '\0';
+        draw_text(canvas, assets.font, 0, y, rng_color(255), line);
+        work.calls += columns;
+        work.pixels += columns * assets.font.glyphWidth * assets.font.glyphHeight;
+    }
+    return work;
+}
+
+//a background and a few translucent full-screen layers on top of it
+static Work sprite_stack(Canvas & canvas, Assets & assets) {
+    draw_sprite(canvas, assets.background, 0, 0);
+    draw_sprite_a1(canvas, assets.overlay, rng_int(-8, 8), rng_int(-8, 8));
+    draw_sprite(canvas, assets.overlay, rng_int(-8, 8), rng_int(-8, 8));
+    draw_sprite(canvas, assets.overlay, rng_int(-8, 8), rng_int(-8, 8), 0.5f);
+    draw_sprite_blend(canvas, assets.overlay, rng_int(-8, 8), rng_int(-8, 8), BLEND_ADD);
+    draw_sprite_blend(canvas, assets.overlay, rng_int(-8, 8), rng_int(-8, 8), BLEND_OVER_LINEAR);
+    return { 6, 6ll * canvas.width * canvas.height };
+}
+
+//lots of little particles, some of them hanging off the edges
+static Work small_sprites(Canvas & canvas, Assets & assets) {
+    draw_sprite(canvas, assets.background, 0, 0);
+    const int count = 2000;
+    for (int i = 0; i < count; ++i) {
+        int x = rng_int(-12, canvas.width - 4), y = rng_int(-12, canvas.height - 4);
+        switch (i % 4) {
+            case 0: draw_sprite(canvas, assets.small, x, y); break;
+            case 1: draw_sprite_flip(canvas, assets.small, x, y, 1); break;
+            case 2: draw_sprite_tinted(canvas, assets.small, x, y, rng_color(rng_int(64, 256))); break;
+            case 3: draw_sprite_blend(canvas, assets.small, x, y, BLEND_SCREEN); break;
+        }
+    }
+    return { count + 1, (i64) count * 16 * 16 + canvas.width * canvas.height };
+}
+
+static Work ovals_and_lights(Canvas & canvas, Assets & assets) {
+    Work work = { 1, canvas.width * canvas.height };
+    fill_rect(canvas, 0, 0, canvas.width, canvas.height, { 20, 24, 32, 255 });
+    for (int i = 0; i < 60; ++i) {
+        int x = rng_int(-20, canvas.width), y = rng_int(-20, canvas.height);
+        int w = rng_int(4, 60), h = rng_int(4, 60);
+        switch (i % 3) {
+            case 0: draw_oval(canvas, x, y, w, h, rng_color(rng_int(64, 256))); break;
+            case 1: draw_oval_add(canvas, x, y, w, h, rng_color(rng_int(64, 256))); break;
+            case 2: add_light(canvas, x, y, w, h, rng_color(255)); break;
+        }
+        work.calls += 1;
+        work.pixels += 4 * w * h; //the bounding box of the ellipse
+    }
+    return work;
+}
+
+//the same quads as transformed_sprites() below, drawn the old way as pairs of textured triangles
+static Work textured_triangles(Canvas & canvas, Assets & assets) {
+    Work work = { 1, canvas.width * canvas.height };
+    fill_rect(canvas, 0, 0, canvas.width, canvas.height, { 0, 0, 0, 255 });
+    Image & tex = assets.texture;
+    for (int i = 0; i < 100; ++i) {
+        Vec2 pos = vec2(rng_int(0, canvas.width), rng_int(0, canvas.height));
+        float rotation = rng_int(0, 628) * 0.01f;
+        float scale = rng_int(50, 300) * 0.01f;
+        Vec2 verts[4] = { vec2(-32, -32), vec2(32, -32), vec2(32, 32), vec2(-32, 32) };
+        for (Vec2 & v : verts) {
+            v = rotate(rotation) * (v * scale) + pos;
+        }
+        draw_textured_triangle(canvas, tex, verts[0].x, verts[0].y, 0, 0, verts[1].x, verts[1].y, 64, 0,
+            verts[2].x, verts[2].y, 64, 64);
+        draw_textured_triangle(canvas, tex, verts[0].x, verts[0].y, 0, 0, verts[2].x, verts[2].y, 64, 64,
+            verts[3].x, verts[3].y, 0, 64);
+        work.calls += 2;
+        work.pixels += 64 * 64 * scale * scale;
+    }
+    return work;
+}
+
+static Work transformed_sprites(Canvas & canvas, Assets & assets, SampleMode sample) {
+    Work work = { 1, canvas.width * canvas.height };
+    fill_rect(canvas, 0, 0, canvas.width, canvas.height, { 0, 0, 0, 255 });
+    for (int i = 0; i < 100; ++i) {
+        Vec2 pos = vec2(rng_int(0, canvas.width), rng_int(0, canvas.height));
+        float rotation = rng_int(0, 628) * 0.01f;
+        float scale = rng_int(50, 300) * 0.01f;
+        draw_transformed_sprite(canvas, assets.texture, pos, rotation, vec2(scale, scale), sample);
+        work.calls += 1;
+        work.pixels += 64 * 64 * scale * scale;
+    }
+    return work;
+}
+
+static Work nearest_sprites(Canvas & canvas, Assets & assets) {
+    return transformed_sprites(canvas, assets, SAMPLE_NEAREST);
+}
+
+static Work bilinear_sprites(Canvas & canvas, Assets & assets) {
+    return transformed_sprites(canvas, assets, SAMPLE_BILINEAR);
+}
+
+//the text frame above drawn into an indexed canvas with some sprites on top, then expanded into the real canvas
+static Work indexed_frame(Canvas & canvas, Assets & assets) {
+    Canvas8 & indexed = assets.indexed;
+    Work work = { 2, 2ll * canvas.width * canvas.height };
+    fill_rect(indexed, 0, 0, indexed.width, indexed.height, 1);
+
+    char line[128];
+    int columns = indexed.width / assets.font.glyphWidth;
+    for (int y = 0; y < indexed.height; y += assets.font.glyphHeight) {
+        for (int i = 0; i < columns; ++i) {
+            line[i] = rng_int(' ', '~' + 1);
+        }
+        line[columns] = '\0';
+        draw_text(indexed, assets.font, 0, y, rng_int(1, 8), line);
+        work.calls += columns;
+        work.pixels += columns * assets.font.glyphWidth * assets.font.glyphHeight;
+    }
+    for (int i = 0; i < 100; ++i) {
+        draw_sprite(indexed, assets.texture8, rng_int(-32, indexed.width), rng_int(-32, indexed.height));
+        work.calls += 1;
+        work.pixels += 64 * 64;
+    }
+
+    expand_canvas8(canvas, indexed, assets.palette);
+    clear_dirty(indexed);
+    return work;
+}
+
+struct Workload {
+    const char * name;
+    Work (* draw) (Canvas & canvas, Assets & assets);
+    u64 golden; //checksum of the canvas after the first frame
+};
+
+static Workload workloads[] = {
+    { "text frame",         text_frame,         0x0c4403be093724dfull },
+    { "sprite stack",       sprite_stack,       0x19acad8256d9b84dull },
+    { "small sprites",      small_sprites,      0xcfe5e88d69c91821ull },
+    { "ovals and lights",   ovals_and_lights,   0x1b5fd000b585918aull },
+    { "textured triangles", textured_triangles, 0x0dd55408088eee83ull },
+    { "nearest sprites",    nearest_sprites,    0x0995c7c367c82420ull },
+    { "bilinear sprites",   bilinear_sprites,   0xb6d5bfeab9294840ull },
+    { "indexed frame",      indexed_frame,      0xe5af122f3b2f80cfull },
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// MAIN                                                                                                             ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//FNV-1a over the visible pixels, row by row, so the margin and pitch padding don't count
+static u64 checksum(Canvas & canvas) {
+    u64 hash = 14695981039346656037ull;
+    for (int y = 0; y < canvas.height; ++y) {
+        u8 * row = (u8 *) canvas[y];
+        for (int i = 0; i < canvas.width * (int) sizeof(Pixel); ++i) {
+            hash = (hash ^ row[i]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char ** argv) {
+    int iterations = 100;
+    bool update = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--update")) {
+            update = true;
+        } else {
+            iterations = imax(1, atoi(argv[i]));
+        }
+    }
+
+    Assets assets = {};
+    assets.font = load_mono_font("res/font-16-white.png", 8, 16);
+    assets.background = make_opaque_image(canvasWidth, canvasHeight);
+    assets.overlay = make_test_image(canvasWidth, canvasHeight, true);
+    assets.small = make_test_image(16, 16, true);
+    assets.texture = make_test_image(64, 64, false);
+    assets.palette = make_palette();
+    for (int i = 0; i < 8; ++i) {
+        palette_index(assets.palette, { (u8) (i * 32), (u8) (255 - i * 16), (u8) (i * 8), 255 });
+    }
+    assets.indexed = make_canvas8(canvasWidth, canvasHeight, 16);
+    assets.texture8 = quantize_image(assets.palette, assets.texture);
+
+    Canvas canvas = make_canvas(canvasWidth, canvasHeight, 16);
+    int failures = 0;
+
+    for (int b = 0; b < BLIT_BACKEND_COUNT; ++b) {
+        if (!blit_backend_supported((BlitBackendType) b)) {
+            printf("%s: not supported on this CPU, skipping\n\n", blitBackends[b].name);
+            continue;
+        }
+        blitBackend = &blitBackends[b];
+        printf("%s:\n", blitBackend->name);
+
+        for (Workload & w : workloads) {
+            //the first frame is the one that gets checked, the rest are timed
+            rngState = 0x9E3779B9;
+            w.draw(canvas, assets);
+            clear_dirty(canvas);
+            u64 hash = checksum(canvas);
+
+            Work work = {};
+            u64 start = get_nanos();
+            for (int i = 0; i < iterations; ++i) {
+                rngState = 0x9E3779B9;
+                work = w.draw(canvas, assets);
+                clear_dirty(canvas);
+            }
+            double nanos = (get_nanos() - start) / (double) iterations;
+
+            const char * status = "ok";
+            if (update) {
+                status = "";
+                if (b == BLIT_SCALAR) {
+                    w.golden = hash;
+                } else if (hash != w.golden) {
+                    status = "MISMATCH with scalar";
+                    ++failures;
+                }
+            } else if (hash != w.golden) {
+                status = "MISMATCH";
+                ++failures;
+            }
+            printf("    %-20s %9.3f ms/frame %11.1f ns/call %7.3f ns/pixel   %016llx %s\n", w.name,
+                nanos / 1'000'000, nanos / work.calls, nanos / work.pixels, (unsigned long long) hash, status);
+        }
+        printf("\n");
+    }
+
+    if (update) {
+        printf("new goldens:\n");
+        for (Workload & w : workloads) {
+            printf("    %-20s 0x%016llxull\n", w.name, (unsigned long long) w.golden);
+        }
+    }
+
+    if (failures) {
+        printf("%d checksum mismatches!\n", failures);
+        return 1;
+    }
+    return 0;
+}
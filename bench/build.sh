@@ -0,0 +1,11 @@
+#!/usr/bin/env sh
+# builds the headless renderer benchmark (see bench.cpp), with the same flags bob uses for lib/
+# NOTE: pixel.cpp contains the GL presenter, so glad has to be linked in, but it never gets called
+cd "$(dirname "$0")/.."
+mkdir -p bench/obj || exit 1
+for f in blit pixel canvas8 Imm stb_image trace; do
+    clang -std=c++14 -c lib/$f.cpp -o bench/obj/$f.o -Ilib -Os || exit 1
+done
+clang -c lib/glad.c -o bench/obj/glad.o -Ilib -Os || exit 1
+clang -std=c++14 -Ilib -Os -o bench/bench bench/bench.cpp bench/obj/*.o -lstdc++ -lm -ldl || exit 1
+rm -r bench/obj
@@ -5,6 +5,26 @@
 
 #include <string.h>
 
+////////////////////////////////////////////////////////////////////////////////
+/// SRGB                                                                     ///
+////////////////////////////////////////////////////////////////////////////////
+
+static SrgbTables make_srgb_tables() {
+    SrgbTables tables;
+    for (int i = 0; i < 256; ++i) {
+        float f = i * (1.0f / 255);
+        tables.toLinear[i] = f <= 0.04045f? f * (1 / 12.92f) : powf((f + 0.055f) * (1 / 1.055f), 2.4f);
+    }
+    for (int i = 0; i < SRGB_ENCODE_STEPS; ++i) {
+        float f = i * (1.0f / (SRGB_ENCODE_STEPS - 1));
+        float s = f <= 0.0031308f? f * 12.92f : 1.055f * powf(f, 1 / 2.4f) - 0.055f;
+        tables.toSrgb[i] = fminf(255, s * 255 + 0.5f);
+    }
+    return tables;
+}
+
+const SrgbTables srgbTables = make_srgb_tables();
+
 ////////////////////////////////////////////////////////////////////////////////
 /// OPENGL UTILS                                                             ///
 ////////////////////////////////////////////////////////////////////////////////
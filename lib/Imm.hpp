@@ -70,16 +70,30 @@ static inline Color color(Vec4 v) {
 	return { (u8)(v.x * f), (u8)(v.y * f), (u8)(v.z * f), (u8)(v.w * f) };
 }
 
-//TODO: do proper sRGB conversion here, not just gamma 2.2!
+//the exact sRGB transfer functions, tabulated because powf() is far too slow to call per pixel
+//NOTE: 4096 steps of linear light are enough that every sRGB byte survives a round trip unchanged
+#define SRGB_ENCODE_STEPS 4096
+struct SrgbTables {
+	float toLinear[256]; //sRGB byte -> linear light in [0, 1]
+	u8 toSrgb[SRGB_ENCODE_STEPS]; //linear light * (SRGB_ENCODE_STEPS - 1) -> nearest sRGB byte
+};
+
+extern const SrgbTables srgbTables;
+
+static inline float srgb_to_linear(u8 c) {
+	return srgbTables.toLinear[c];
+}
+
+static inline u8 linear_to_srgb(float f) {
+	return srgbTables.toSrgb[(int) (fminf(1, fmaxf(0, f)) * (SRGB_ENCODE_STEPS - 1) + 0.5f)];
+}
+
 static inline Vec4 srgb_to_linear(Color c) {
-    Vec4 n = vec4(c.r, c.g, c.b, c.a) * (1.0f / 255);
-    return vec4(powf(n.x, 2.2f), powf(n.y, 2.2f), powf(n.z, 2.2f), n.w);
+	return vec4(srgb_to_linear(c.r), srgb_to_linear(c.g), srgb_to_linear(c.b), c.a * (1.0f / 255));
 }
 
 static inline Color linear_to_srgb(Vec4 v) {
-	float exp = 1 / 2.2f;
-	Vec4 n = vec4(powf(v.x, exp), powf(v.y, exp), powf(v.z, exp), v.w);
-	return { (u8) (n.x * 255), (u8) (n.y * 255), (u8) (n.z * 255), (u8) (n.w * 255) };
+	return { linear_to_srgb(v.x), linear_to_srgb(v.y), linear_to_srgb(v.z), (u8) (fminf(1, fmaxf(0, v.w)) * 255 + 0.5f) };
 }
 
 struct Vertex {
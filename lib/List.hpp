@@ -42,6 +42,16 @@ struct List {
         ++len;
     }
 
+    //inserts before the element currently at `index`, shifting it and everything after it up by one
+    void insert(size_t index, TYPE t) {
+        assert(index <= len);
+        add(t);
+        for (size_t i = len - 1; i > index; --i) {
+            data[i] = data[i - 1];
+        }
+        data[index] = t;
+    }
+
     //TODO: create unsafe_add() method (that doesn't do the resize check) and use it where relevant
 
     void remove(size_t index) {
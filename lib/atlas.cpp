@@ -0,0 +1,94 @@
+#include "atlas.hpp"
+
+#define ATLAS_ALIGN 4 //pixels, so 16 bytes
+
+static AtlasPage make_page(int width, int height) {
+    //round the pitch up to a whole number of 64-byte cache lines,
+    //and leave some slack at the end for SIMD loads that run off the last row
+    int pitch = (width + 15) / 16 * 16;
+    AtlasPage page = { { (Pixel *) calloc(pitch * height + 16, sizeof(Pixel)), width, height, pitch } };
+    page.skyline.add({ 0, 0, width });
+    return page;
+}
+
+//finds the lowest spot (leftmost among equals) where a `width` x `height` rect fits on top of the skyline,
+//and returns the index of the segment its left edge lands on, or -1 if there's no room
+static int find_spot(AtlasPage & page, int width, int height, int & bestX, int & bestY) {
+    int best = -1;
+    bestY = page.image.height;
+    for (int i = 0; i < (int) page.skyline.len; ++i) {
+        int x = page.skyline[i].x;
+        if (x + width > page.image.width) break;
+
+        //the rect rests on the highest segment underneath it
+        int y = 0;
+        for (int j = i, covered = 0; covered < width; covered += page.skyline[j++].width) {
+            y = imax(y, page.skyline[j].y);
+        }
+        if (y + height <= page.image.height && y < bestY) {
+            best = i;
+            bestX = x;
+            bestY = y;
+        }
+    }
+    return best;
+}
+
+//raises the skyline over [x, x + width) to `top`
+static void place(AtlasPage & page, int index, int x, int width, int top) {
+    page.skyline.insert(index, { x, top, width });
+
+    //shrink or remove the segments the new one now covers
+    int end = x + width;
+    int i = index + 1;
+    while (i < (int) page.skyline.len && page.skyline[i].x < end) {
+        AtlasPage::Segment & s = page.skyline[i];
+        if (s.x + s.width <= end) {
+            page.skyline.remove(i);
+        } else {
+            s.width -= end - s.x;
+            s.x = end;
+            break;
+        }
+    }
+
+    //merge neighbors at the same height, so the skyline doesn't fragment
+    for (int i = 0; i + 1 < (int) page.skyline.len; ) {
+        AtlasPage::Segment & s = page.skyline[i];
+        if (s.y == page.skyline[i + 1].y) {
+            s.width += page.skyline[i + 1].width;
+            page.skyline.remove(i + 1);
+        } else {
+            ++i;
+        }
+    }
+}
+
+Image atlas_add(Atlas & atlas, Image & image) {
+    int width = (image.width + ATLAS_ALIGN - 1) / ATLAS_ALIGN * ATLAS_ALIGN;
+    int height = image.height;
+
+    AtlasPage * page = nullptr;
+    int index = -1, x, y;
+    for (AtlasPage & p : atlas.pages) {
+        index = find_spot(p, width, height, x, y);
+        if (index >= 0) {
+            page = &p;
+            break;
+        }
+    }
+    if (!page) {
+        atlas.pages.add(make_page(imax(atlas.pageWidth, width), imax(atlas.pageHeight, height)));
+        page = &atlas.pages[atlas.pages.len - 1];
+        index = find_spot(*page, width, height, x, y);
+        assert(index >= 0);
+    }
+    place(*page, index, x, width, y + height);
+
+    //the copy has the same contents, so it keeps the same serial
+    Image view = { &page->image[y][x], image.width, image.height, page->image.pitch, image.serial };
+    for (int row = 0; row < image.height; ++row) {
+        memcpy(view[row], image[row], image.width * sizeof(Pixel));
+    }
+    return view;
+}
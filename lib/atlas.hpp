@@ -0,0 +1,56 @@
+#ifndef ATLAS_HPP
+#define ATLAS_HPP
+
+#include "pixel.hpp"
+
+//packs images into a few big shared pages, and hands out Image views into them, so that everything a scene draws
+//sits close together in memory, and there's only one buffer per page to upload if the pixels ever go to the GPU
+//NOTE: images are packed with skyline bottom-left: each page tracks the height of its contents across its width,
+//      and every new image goes wherever it ends up lowest, which wastes little space as long as
+//      images are added roughly tallest first
+//NOTE: every view's rows start 16-byte aligned, since widths get rounded up to a multiple of 4 pixels when packing
+
+struct AtlasPage {
+    Image image; //the whole page, which every image packed into it is a view of
+    struct Segment { int x, y, width; };
+    List<Segment> skyline; //left to right, covering the full width of the page
+};
+
+struct Atlas {
+    int pageWidth, pageHeight; //size of new pages, unless an image too big to fit needs a bigger one
+    List<AtlasPage> pages;
+};
+
+static inline Atlas make_atlas(int pageWidth = 1024, int pageHeight = 1024) {
+    return { pageWidth, pageHeight };
+}
+
+//copies the image into the atlas, and returns a view of the copy
+Image atlas_add(Atlas & atlas, Image & image);
+
+//moves an image that owns its pixels (e.g. one from load_image()) into the atlas, freeing the original
+static inline void atlas_move(Atlas & atlas, Image & image) {
+    Image view = atlas_add(atlas, image);
+    free(image.pixels);
+    image = view;
+}
+
+static inline Image atlas_load_image(Atlas & atlas, const char * filepath) {
+    Image image = load_image(filepath);
+    atlas_move(atlas, image);
+    return image;
+}
+
+static inline Tileset atlas_load_tileset(Atlas & atlas, const char * filepath,
+    int tileWidth, int tileHeight, float frame_time = 10000.0f)
+{
+    Tileset set = load_tileset(filepath, tileWidth, tileHeight, frame_time);
+    atlas_move(atlas, set.image);
+    return set;
+}
+
+static inline void atlas_add_font(Atlas & atlas, MonoFont & font) {
+    atlas_move(atlas, font.cells);
+}
+
+#endif //ATLAS_HPP
@@ -0,0 +1,294 @@
+#include "pixel.hpp"
+#include <cpuid.h>
+
+//NOTE: the game is compiled for baseline x86-64, so everything past SSE2 is enabled per-function
+//      with target attributes, and only called after checking for support at runtime (see select_blit_backend())
+
+//every byte value repeated across all four channels, so that per-pixel weights can be gathered like texels
+static const struct SplatTable {
+    Pixel pixels[256];
+    SplatTable() { for (int i = 0; i < 256; ++i) pixels[i] = { (u8) i, (u8) i, (u8) i, (u8) i }; }
+} splatTable;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// SCALAR                                                                                                           ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace blit_scalar {
+    #define BLIT_TARGET
+    typedef Pixel Vec;
+    static const int LANES = 1;
+
+    static inline Vec load(const Pixel * p) { return *p; }
+    static inline Vec load_reversed(const Pixel * last) { return *last; }
+    static inline void store(Pixel * p, Vec v) { *p = v; }
+    static inline Vec splat(Pixel p) { return p; }
+    static inline Vec gather(const Pixel * base, const int * offsets) { return base[offsets[0]]; }
+
+    static inline Vec keep_alpha(Vec c, Vec d) {
+        c.a = d.a;
+        return c;
+    }
+
+    struct Wide { int c[4]; };
+    static inline Wide wide(Vec v) { return {{ v.r, v.g, v.b, v.a }}; }
+    static inline u8 saturate(int i) { return imax(0, imin(255, i)); }
+    static inline Vec pack(Wide w) { return { saturate(w.c[0]), saturate(w.c[1]), saturate(w.c[2]), saturate(w.c[3]) }; }
+
+    static inline Wide add(Wide a, Wide b) { for (int i = 0; i < 4; ++i) a.c[i] += b.c[i]; return a; }
+    static inline Wide sub(Wide a, Wide b) { for (int i = 0; i < 4; ++i) a.c[i] -= b.c[i]; return a; }
+    static inline Wide mul(Wide a, Wide b) { for (int i = 0; i < 4; ++i) a.c[i] *= b.c[i]; return a; }
+    static inline Wide shr8(Wide a) { for (int i = 0; i < 4; ++i) a.c[i] >>= 8; return a; }
+    static inline Wide alpha(Wide a) { return {{ a.c[3], a.c[3], a.c[3], a.c[3] }}; }
+    static inline Wide splat16(int i) { return {{ i, i, i, i }}; }
+
+    template <typename OP>
+    static inline Vec combine(Vec s, Vec d) { return pack(OP::apply(wide(s), wide(d))); }
+    template <typename OP>
+    static inline Vec combine3(Vec a, Vec b, Vec c) { return pack(OP::apply(wide(a), wide(b), wide(c))); }
+
+    static inline Vec select_opaque(Vec test, Vec a, Vec b) {
+        return test.a > 127? a : b;
+    }
+
+    static inline bool any_translucent(Vec v) {
+        return v.a > 127 && v.a < 255;
+    }
+
+    #include "blit_kernels.hpp"
+    #undef BLIT_TARGET
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// SSE2                                                                                                             ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace blit_sse2 {
+    #define BLIT_TARGET
+    typedef __m128i Vec;
+    static const int LANES = 4;
+
+    static inline Vec load(const Pixel * p) { return _mm_loadu_si128((__m128i *) p); }
+    static inline void store(Pixel * p, Vec v) { _mm_storeu_si128((__m128i *) p, v); }
+    static inline Vec splat(Pixel p) { u32 u; memcpy(&u, &p, 4); return _mm_set1_epi32(u); }
+
+    static inline Vec load_reversed(const Pixel * last) {
+        return _mm_shuffle_epi32(load(last - 3), _MM_SHUFFLE(0, 1, 2, 3));
+    }
+
+    //built from scalar loads in registers, since going through memory would stall on store forwarding
+    static inline Vec load1(const Pixel * p) { u32 u; memcpy(&u, p, 4); return _mm_cvtsi32_si128(u); }
+    static inline Vec gather(const Pixel * base, const int * offsets) {
+        return _mm_unpacklo_epi64(_mm_unpacklo_epi32(load1(base + offsets[0]), load1(base + offsets[1])),
+                                  _mm_unpacklo_epi32(load1(base + offsets[2]), load1(base + offsets[3])));
+    }
+
+    static inline Vec keep_alpha(Vec c, Vec d) {
+        const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+        return _mm_or_si128(_mm_andnot_si128(alphaMask, c), _mm_and_si128(alphaMask, d));
+    }
+
+    //products of two channels never exceed 16 bits, so plain 16-bit lanes are enough for all blend math
+    typedef __m128i Wide;
+    static inline Wide lo(Vec v) { return _mm_unpacklo_epi8(v, _mm_setzero_si128()); }
+    static inline Wide hi(Vec v) { return _mm_unpackhi_epi8(v, _mm_setzero_si128()); }
+    static inline Vec pack(Wide l, Wide h) { return _mm_packus_epi16(l, h); }
+
+    static inline Wide add(Wide a, Wide b) { return _mm_add_epi16(a, b); }
+    static inline Wide sub(Wide a, Wide b) { return _mm_sub_epi16(a, b); }
+    static inline Wide mul(Wide a, Wide b) { return _mm_mullo_epi16(a, b); }
+    static inline Wide shr8(Wide a) { return _mm_srli_epi16(a, 8); }
+    static inline Wide alpha(Wide a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xFF), 0xFF); }
+    static inline Wide splat16(int i) { return _mm_set1_epi16(i); }
+
+    template <typename OP>
+    static inline Vec combine(Vec s, Vec d) { return pack(OP::apply(lo(s), lo(d)), OP::apply(hi(s), hi(d))); }
+    template <typename OP>
+    static inline Vec combine3(Vec a, Vec b, Vec c) {
+        return pack(OP::apply(lo(a), lo(b), lo(c)), OP::apply(hi(a), hi(b), hi(c)));
+    }
+
+    static inline Vec select_opaque(Vec test, Vec a, Vec b) {
+        __m128i mask = _mm_srai_epi32(test, 31);
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    static inline bool any_translucent(Vec v) {
+        __m128i a = _mm_srli_epi32(v, 24);
+        __m128i mask = _mm_andnot_si128(_mm_cmpeq_epi32(a, _mm_set1_epi32(255)),
+                                        _mm_cmpgt_epi32(a, _mm_set1_epi32(127)));
+        return _mm_movemask_epi8(mask) != 0;
+    }
+
+    #include "blit_kernels.hpp"
+    #undef BLIT_TARGET
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// SSE4.1                                                                                                           ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace blit_sse41 {
+    #define BLIT_TARGET __attribute__((target("sse4.1")))
+    typedef __m128i Vec;
+    static const int LANES = 4;
+
+    BLIT_TARGET static inline Vec load(const Pixel * p) { return _mm_loadu_si128((__m128i *) p); }
+    BLIT_TARGET static inline void store(Pixel * p, Vec v) { _mm_storeu_si128((__m128i *) p, v); }
+    BLIT_TARGET static inline Vec splat(Pixel p) { u32 u; memcpy(&u, &p, 4); return _mm_set1_epi32(u); }
+
+    BLIT_TARGET static inline Vec load_reversed(const Pixel * last) {
+        return _mm_shuffle_epi32(load(last - 3), _MM_SHUFFLE(0, 1, 2, 3));
+    }
+
+    BLIT_TARGET static inline int load1(const Pixel * p) { int i; memcpy(&i, p, 4); return i; }
+    BLIT_TARGET static inline Vec gather(const Pixel * base, const int * offsets) {
+        Vec v = _mm_cvtsi32_si128(load1(base + offsets[0]));
+        v = _mm_insert_epi32(v, load1(base + offsets[1]), 1);
+        v = _mm_insert_epi32(v, load1(base + offsets[2]), 2);
+        return _mm_insert_epi32(v, load1(base + offsets[3]), 3);
+    }
+
+    BLIT_TARGET static inline Vec keep_alpha(Vec c, Vec d) {
+        return _mm_blendv_epi8(c, d, _mm_set1_epi32(0xFF000000));
+    }
+
+    typedef __m128i Wide;
+    BLIT_TARGET static inline Wide lo(Vec v) { return _mm_cvtepu8_epi16(v); }
+    BLIT_TARGET static inline Wide hi(Vec v) { return _mm_unpackhi_epi8(v, _mm_setzero_si128()); }
+    BLIT_TARGET static inline Vec pack(Wide l, Wide h) { return _mm_packus_epi16(l, h); }
+
+    BLIT_TARGET static inline Wide add(Wide a, Wide b) { return _mm_add_epi16(a, b); }
+    BLIT_TARGET static inline Wide sub(Wide a, Wide b) { return _mm_sub_epi16(a, b); }
+    BLIT_TARGET static inline Wide mul(Wide a, Wide b) { return _mm_mullo_epi16(a, b); }
+    BLIT_TARGET static inline Wide shr8(Wide a) { return _mm_srli_epi16(a, 8); }
+    BLIT_TARGET static inline Wide splat16(int i) { return _mm_set1_epi16(i); }
+    BLIT_TARGET static inline Wide alpha(Wide a) {
+        return _mm_shuffle_epi8(a, _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15));
+    }
+
+    template <typename OP>
+    BLIT_TARGET static inline Vec combine(Vec s, Vec d) {
+        return pack(OP::apply(lo(s), lo(d)), OP::apply(hi(s), hi(d)));
+    }
+    template <typename OP>
+    BLIT_TARGET static inline Vec combine3(Vec a, Vec b, Vec c) {
+        return pack(OP::apply(lo(a), lo(b), lo(c)), OP::apply(hi(a), hi(b), hi(c)));
+    }
+
+    BLIT_TARGET static inline Vec select_opaque(Vec test, Vec a, Vec b) {
+        return _mm_blendv_epi8(b, a, _mm_srai_epi32(test, 31));
+    }
+
+    BLIT_TARGET static inline bool any_translucent(Vec v) {
+        __m128i a = _mm_srli_epi32(v, 24);
+        __m128i mask = _mm_andnot_si128(_mm_cmpeq_epi32(a, _mm_set1_epi32(255)),
+                                        _mm_cmpgt_epi32(a, _mm_set1_epi32(127)));
+        return !_mm_testz_si128(mask, mask);
+    }
+
+    #include "blit_kernels.hpp"
+    #undef BLIT_TARGET
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// AVX2                                                                                                             ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace blit_avx2 {
+    #define BLIT_TARGET __attribute__((target("avx2")))
+    typedef __m256i Vec;
+    static const int LANES = 8;
+
+    BLIT_TARGET static inline Vec load(const Pixel * p) { return _mm256_loadu_si256((__m256i *) p); }
+    BLIT_TARGET static inline void store(Pixel * p, Vec v) { _mm256_storeu_si256((__m256i *) p, v); }
+    BLIT_TARGET static inline Vec splat(Pixel p) { u32 u; memcpy(&u, &p, 4); return _mm256_set1_epi32(u); }
+
+    BLIT_TARGET static inline Vec load_reversed(const Pixel * last) {
+        return _mm256_permutevar8x32_epi32(load(last - 7), _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    }
+
+    BLIT_TARGET static inline Vec gather(const Pixel * base, const int * offsets) {
+        return _mm256_i32gather_epi32((const int *) base, _mm256_loadu_si256((__m256i *) offsets), 4);
+    }
+
+    BLIT_TARGET static inline Vec keep_alpha(Vec c, Vec d) {
+        return _mm256_blendv_epi8(c, d, _mm256_set1_epi32(0xFF000000));
+    }
+
+    //unpacks and packs work within 128-bit halves, but since they undo each other that doesn't matter here
+    typedef __m256i Wide;
+    BLIT_TARGET static inline Wide lo(Vec v) { return _mm256_unpacklo_epi8(v, _mm256_setzero_si256()); }
+    BLIT_TARGET static inline Wide hi(Vec v) { return _mm256_unpackhi_epi8(v, _mm256_setzero_si256()); }
+    BLIT_TARGET static inline Vec pack(Wide l, Wide h) { return _mm256_packus_epi16(l, h); }
+
+    BLIT_TARGET static inline Wide add(Wide a, Wide b) { return _mm256_add_epi16(a, b); }
+    BLIT_TARGET static inline Wide sub(Wide a, Wide b) { return _mm256_sub_epi16(a, b); }
+    BLIT_TARGET static inline Wide mul(Wide a, Wide b) { return _mm256_mullo_epi16(a, b); }
+    BLIT_TARGET static inline Wide shr8(Wide a) { return _mm256_srli_epi16(a, 8); }
+    BLIT_TARGET static inline Wide splat16(int i) { return _mm256_set1_epi16(i); }
+    BLIT_TARGET static inline Wide alpha(Wide a) {
+        return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, 0xFF), 0xFF);
+    }
+
+    template <typename OP>
+    BLIT_TARGET static inline Vec combine(Vec s, Vec d) {
+        return pack(OP::apply(lo(s), lo(d)), OP::apply(hi(s), hi(d)));
+    }
+    template <typename OP>
+    BLIT_TARGET static inline Vec combine3(Vec a, Vec b, Vec c) {
+        return pack(OP::apply(lo(a), lo(b), lo(c)), OP::apply(hi(a), hi(b), hi(c)));
+    }
+
+    BLIT_TARGET static inline Vec select_opaque(Vec test, Vec a, Vec b) {
+        return _mm256_blendv_epi8(b, a, _mm256_srai_epi32(test, 31));
+    }
+
+    BLIT_TARGET static inline bool any_translucent(Vec v) {
+        __m256i a = _mm256_srli_epi32(v, 24);
+        __m256i mask = _mm256_andnot_si256(_mm256_cmpeq_epi32(a, _mm256_set1_epi32(255)),
+                                           _mm256_cmpgt_epi32(a, _mm256_set1_epi32(127)));
+        return !_mm256_testz_si256(mask, mask);
+    }
+
+    #include "blit_kernels.hpp"
+    #undef BLIT_TARGET
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// DISPATCH                                                                                                         ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+const BlitBackend blitBackends[BLIT_BACKEND_COUNT] = {
+    blit_scalar::make_backend("scalar"),
+    blit_sse2::make_backend("sse2"),
+    blit_sse41::make_backend("sse4.1"),
+    blit_avx2::make_backend("avx2"),
+};
+
+//SSE2 is part of baseline x86-64, so it's a safe default even before select_blit_backend() gets called
+const BlitBackend * blitBackend = &blitBackends[BLIT_SSE2];
+
+bool blit_backend_supported(BlitBackendType type) {
+    uint eax, ebx, ecx, edx;
+    if (type <= BLIT_SSE2) return true;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    bool sse41 = (ecx & bit_SSE4_1) && (ecx & bit_SSSE3);
+    if (type == BLIT_SSE41) return sse41;
+
+    //AVX2 also needs the OS to save and restore the upper halves of the ymm registers
+    bool osxsave = (ecx & bit_OSXSAVE) && (ecx & bit_AVX);
+    if (!sse41 || !osxsave || __get_cpuid_max(0, nullptr) < 7) return false;
+    uint xcr0lo, xcr0hi;
+    __asm__ volatile ("xgetbv" : "=a" (xcr0lo), "=d" (xcr0hi) : "c" (0));
+    if ((xcr0lo & 6) != 6) return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return ebx & bit_AVX2;
+}
+
+const BlitBackend * select_blit_backend(BlitBackendType type) {
+    int best = imin(type, BLIT_BACKEND_COUNT - 1);
+    while (!blit_backend_supported((BlitBackendType) best)) --best;
+    blitBackend = &blitBackends[best];
+    return blitBackend;
+}
@@ -0,0 +1,343 @@
+//NOTE: this file intentionally has no include guard!
+//      blit.cpp includes it once per instruction set, each time inside a different namespace which provides:
+//          BLIT_TARGET                 function attribute that enables the instruction set
+//          Vec, LANES                  the vector type and how many pixels it holds
+//          load(), store(), load_reversed(), splat(), gather(), select_opaque(), any_translucent(), keep_alpha()
+//          Wide                        pixel channels widened to 16 bits, so they can be multiplied without overflow
+//          add(), sub(), mul(), shr8(), alpha(), splat16(), combine<OP>(), combine3<OP>()
+//      everything below is written only in terms of those, so each backend gets identical logic,
+//      and the scalar backend (LANES == 1) doubles as the reference implementation for the others
+
+//partial loads and stores go through a temporary so that we never read or write
+//pixels outside of the clipped region (which would not be safe if another thread were drawing next to us)
+BLIT_TARGET static inline Vec load_n(const Pixel * p, int n) {
+    if (n == LANES) return load(p);
+    Pixel tmp[LANES] = {};
+    memcpy(tmp, p, n * sizeof(Pixel));
+    return load(tmp);
+}
+
+//loads the `n` pixels ending at `last` in reverse order, so that lane i holds last[-i]
+BLIT_TARGET static inline Vec load_reversed_n(const Pixel * last, int n) {
+    if (n == LANES) return load_reversed(last);
+    Pixel tmp[LANES] = {};
+    memcpy(tmp + LANES - n, last - (n - 1), n * sizeof(Pixel));
+    return load_reversed(tmp + LANES - 1);
+}
+
+BLIT_TARGET static inline void store_n(Pixel * p, Vec v, int n) {
+    if (n == LANES) return store(p, v);
+    Pixel tmp[LANES];
+    store(tmp, v);
+    memcpy(p, tmp, n * sizeof(Pixel));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BLEND POLICIES                                                                                                   ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//x / 255 rounded to nearest, valid for x in [0, 255 * 255] so it can't overflow 16-bit lanes
+BLIT_TARGET static inline Wide div255(Wide x) {
+    x = add(x, splat16(128));
+    return shr8(add(x, shr8(x)));
+}
+
+//blend modes that work per color channel only need to define apply() on widened channels,
+//the rest (unpacking, packing with saturation, keeping destination alpha) is shared
+//NOTE: sources are premultiplied, which is what makes every mode below a single multiply and divide per channel
+template <typename OP>
+struct BlendChannels {
+    BLIT_TARGET static inline Vec blend(Vec s, Vec d) { return keep_alpha(combine<OP>(s, d), d); }
+};
+
+struct BlendReplace {
+    BLIT_TARGET static inline Vec blend(Vec s, Vec d) { return s; }
+};
+
+//s + d * (1 - a)
+struct BlendOver : BlendChannels<BlendOver> {
+    BLIT_TARGET static inline Wide apply(Wide s, Wide d) {
+        return add(s, div255(mul(d, sub(splat16(255), alpha(s)))));
+    }
+};
+
+//s + d, saturated by the final pack
+struct BlendAdd : BlendChannels<BlendAdd> {
+    BLIT_TARGET static inline Wide apply(Wide s, Wide d) { return add(s, d); }
+};
+
+//s * d + d * (1 - a), i.e. multiply faded in by source alpha
+struct BlendMultiply : BlendChannels<BlendMultiply> {
+    BLIT_TARGET static inline Wide apply(Wide s, Wide d) {
+        return div255(mul(d, add(s, sub(splat16(255), alpha(s)))));
+    }
+};
+
+//s + d - s * d, i.e. screen faded in by source alpha
+struct BlendScreen : BlendChannels<BlendScreen> {
+    BLIT_TARGET static inline Wide apply(Wide s, Wide d) {
+        return add(s, div255(mul(d, sub(splat16(255), s))));
+    }
+};
+
+//goes through the tables in blend_over_linear() one pixel at a time, since there's nothing to gain from
+//widening when every channel is a lookup anyway (and it keeps every backend bit-identical for free)
+struct BlendOverLinear {
+    BLIT_TARGET static inline Vec blend(Vec s, Vec d) {
+        Pixel sp[LANES], dp[LANES];
+        store(sp, s);
+        store(dp, d);
+        for (int i = 0; i < LANES; ++i) dp[i] = blend_over_linear(sp[i], dp[i]);
+        return load(dp);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// SOURCE POLICIES                                                                                                  ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//sources with `alphaTest` set only touch destination pixels where the raw source alpha is above 127
+
+struct SourceCopy {
+    static const bool alphaTest = false;
+    BLIT_TARGET SourceCopy(const Blit & b) {}
+    BLIT_TARGET inline Vec apply(Vec raw) { return raw; }
+};
+
+//multiplies every channel, including alpha, by a premultiplied color
+struct SourceTint {
+    static const bool alphaTest = false;
+    Vec tint;
+    struct Op {
+        BLIT_TARGET static inline Wide apply(Wide s, Wide t) { return div255(mul(s, t)); }
+    };
+    BLIT_TARGET SourceTint(const Blit & b) : tint(splat(premultiply(b.color))) {}
+    BLIT_TARGET SourceTint(Pixel t) : tint(splat(t)) {}
+    BLIT_TARGET inline Vec apply(Vec raw) { return combine<Op>(raw, tint); }
+};
+
+//since the source is premultiplied, fading it out means scaling all four channels
+struct SourceAlpha : SourceTint {
+    BLIT_TARGET static inline Pixel fade(float alpha) {
+        u8 level = fmaxf(0, fminf(255, alpha * 255 + 0.5f));
+        return { level, level, level, level };
+    }
+    BLIT_TARGET SourceAlpha(const Blit & b) : SourceTint(fade(b.alpha)) {}
+};
+
+struct SourceFill {
+    static const bool alphaTest = true;
+    Vec fill;
+    BLIT_TARGET SourceFill(const Blit & b) : fill(splat(premultiply(b.color))) {}
+    BLIT_TARGET inline Vec apply(Vec raw) { return fill; }
+};
+
+//1-bit alpha means the pixels that pass the test are drawn fully opaque, so the few translucent ones
+//(the edges, usually) get unpremultiplied back to their full color. that's a divide, which goes one pixel at a time
+//like BlendOverLinear does, keeping every backend bit-identical, and is skipped entirely for all-opaque vectors
+struct SourceCutout {
+    static const bool alphaTest = true;
+    BLIT_TARGET SourceCutout(const Blit & b) {}
+    BLIT_TARGET inline Vec apply(Vec raw) {
+        if (!any_translucent(raw)) return raw;
+        Pixel p[LANES];
+        store(p, raw);
+        for (int i = 0; i < LANES; ++i) {
+            if (p[i].a <= 127 || p[i].a == 255) continue;
+            Color c = unpremultiply(p[i]);
+            p[i] = { c.r, c.g, c.b, 255 };
+        }
+        return load(p);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// FLIP POLICIES                                                                                                    ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct NoFlip {
+    BLIT_TARGET static inline Vec load(const Pixel * row, int x, int n) { return load_n(row + x, n); }
+};
+
+struct FlipX {
+    BLIT_TARGET static inline Vec load(const Pixel * row, int x, int n) { return load_reversed_n(row - x, n); }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// KERNEL                                                                                                           ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template <typename BLEND, typename SOURCE, typename FLIP>
+BLIT_TARGET static void blit(const Blit & b) {
+    SOURCE source(b);
+    for (int y = 0; y < b.h; ++y) {
+        Pixel * dst = b.dst + y * b.dstPitch;
+        Pixel * src = b.src + y * b.srcPitch;
+        for (int x = 0; x < b.w; x += LANES) {
+            int n = imin(LANES, b.w - x);
+            Vec raw = FLIP::load(src, x, n);
+            Vec d = load_n(dst + x, n);
+            Vec c = BLEND::blend(source.apply(raw), d);
+            if (SOURCE::alphaTest) c = select_opaque(raw, c, d);
+            store_n(dst + x, c, n);
+        }
+    }
+}
+
+//blends a solid color over a region, ignoring the source entirely
+template <typename BLEND>
+BLIT_TARGET static void fill(const Blit & b) {
+    Vec color = splat(premultiply(b.color));
+    for (int y = 0; y < b.h; ++y) {
+        Pixel * dst = b.dst + y * b.dstPitch;
+        for (int x = 0; x < b.w; x += LANES) {
+            int n = imin(LANES, b.w - x);
+            store_n(dst + x, BLEND::blend(color, load_n(dst + x, n)), n);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// AFFINE KERNELS                                                                                                   ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//(a * (256 - w) + b * w) / 256 rounded to nearest, with w in [0, 255] so the sum can't overflow 16-bit lanes
+struct Lerp {
+    BLIT_TARGET static inline Wide apply(Wide a, Wide b, Wide w) {
+        return shr8(add(add(mul(a, sub(splat16(256), w)), mul(b, w)), splat16(128)));
+    }
+};
+
+//the texel at (x, y), or transparent black if that's outside the texture
+BLIT_TARGET static inline Pixel fetch_or_clear(const AffineSpan & s, int x, int y) {
+    if (x < 0 || y < 0 || x >= s.texWidth || y >= s.texHeight) return {};
+    return s.tex[y * s.texPitch + x];
+}
+
+//samplers fetch LANES pixels' worth of texels starting from (u, v). the CHECKED versions bounds-check every tap,
+//and are used for edge spans and for the leftover pixels at the end of a span (which may step off the texture)
+//NOTE: the lane loops have a constant trip count, so they unroll, and the per-lane values stay in registers
+
+template <bool CHECKED>
+struct SampleNearest {
+    BLIT_TARGET static inline Vec sample(const AffineSpan & s, int u, int v) {
+        if (CHECKED) {
+            Pixel texels[LANES];
+            for (int i = 0; i < LANES; ++i) texels[i] = fetch_or_clear(s, (u + i * s.du) >> 16, (v + i * s.dv) >> 16);
+            return load(texels);
+        }
+        int offsets[LANES];
+        for (int i = 0; i < LANES; ++i) offsets[i] = ((v + i * s.dv) >> 16) * s.texPitch + ((u + i * s.du) >> 16);
+        return gather(s.tex, offsets);
+    }
+};
+
+template <bool CHECKED>
+struct SampleBilinear {
+    BLIT_TARGET static inline Vec sample(const AffineSpan & s, int u, int v) {
+        //the weights of the right and bottom texels get looked up already splatted across all four channels,
+        //so they widen the same way colors do
+        int offsets[LANES], fx[LANES], fy[LANES];
+        for (int i = 0; i < LANES; ++i) {
+            int tu = u + i * s.du, tv = v + i * s.dv;
+            offsets[i] = (tv >> 16) * s.texPitch + (tu >> 16);
+            fx[i] = tu >> 8 & 255;
+            fy[i] = tv >> 8 & 255;
+        }
+
+        Vec a, b, c, d;
+        if (CHECKED) {
+            Pixel taps[4][LANES];
+            for (int i = 0; i < LANES; ++i) {
+                int x = (u + i * s.du) >> 16, y = (v + i * s.dv) >> 16;
+                taps[0][i] = fetch_or_clear(s, x, y);
+                taps[1][i] = fetch_or_clear(s, x + 1, y);
+                taps[2][i] = fetch_or_clear(s, x, y + 1);
+                taps[3][i] = fetch_or_clear(s, x + 1, y + 1);
+            }
+            a = load(taps[0]);
+            b = load(taps[1]);
+            c = load(taps[2]);
+            d = load(taps[3]);
+        } else {
+            a = gather(s.tex, offsets);
+            b = gather(s.tex + 1, offsets);
+            c = gather(s.tex + s.texPitch, offsets);
+            d = gather(s.tex + s.texPitch + 1, offsets);
+        }
+        Vec wx = gather(splatTable.pixels, fx);
+        return combine3<Lerp>(combine3<Lerp>(a, b, wx), combine3<Lerp>(c, d, wx), gather(splatTable.pixels, fy));
+    }
+};
+
+template <template <bool> class SAMPLER, bool EDGE>
+BLIT_TARGET static void affine(const AffineSpan & span) {
+    //a local copy, so the compiler knows the stores to `dst` can't change any of it
+    AffineSpan s = span;
+    int u = s.u, v = s.v;
+    int x = 0;
+    for (; x + LANES <= s.w; x += LANES) {
+        Vec c = SAMPLER<EDGE>::sample(s, u, v);
+        store(s.dst + x, BlendOver::blend(c, load(s.dst + x)));
+        u += s.du * LANES;
+        v += s.dv * LANES;
+    }
+    if (x < s.w) {
+        int n = s.w - x;
+        Vec c = SAMPLER<true>::sample(s, u, v);
+        store_n(s.dst + x, BlendOver::blend(c, load_n(s.dst + x, n)), n);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// PALETTE EXPANSION                                                                                                ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//the indices are the gather offsets into the palette, so backends with a real gather expand LANES pixels at once
+BLIT_TARGET static void expand(const Expand & e) {
+    for (int y = 0; y < e.h; ++y) {
+        Pixel * dst = e.dst + y * e.dstPitch;
+        const u8 * src = e.src + y * e.srcPitch;
+        int x = 0;
+        for (; x + LANES <= e.w; x += LANES) {
+            int offsets[LANES];
+            for (int i = 0; i < LANES; ++i) offsets[i] = src[x + i];
+            store(dst + x, gather(e.palette, offsets));
+        }
+        for (; x < e.w; ++x) {
+            dst[x] = e.palette[src[x]];
+        }
+    }
+}
+
+template <typename BLEND, typename SOURCE>
+static void add_blit(BlitBackend & backend, BlendMode blend, SourceMode source) {
+    backend.blit[blend][source][0] = blit<BLEND, SOURCE, NoFlip>;
+    backend.blit[blend][source][1] = blit<BLEND, SOURCE, FlipX>;
+}
+
+template <typename BLEND>
+static void add_blend(BlitBackend & backend, BlendMode blend) {
+    backend.fill[blend] = fill<BLEND>;
+    add_blit<BLEND, SourceCopy>(backend, blend, SOURCE_COPY);
+    add_blit<BLEND, SourceAlpha>(backend, blend, SOURCE_ALPHA);
+    add_blit<BLEND, SourceTint>(backend, blend, SOURCE_TINT);
+    add_blit<BLEND, SourceFill>(backend, blend, SOURCE_FILL);
+    add_blit<BLEND, SourceCutout>(backend, blend, SOURCE_CUTOUT);
+}
+
+static BlitBackend make_backend(const char * name) {
+    BlitBackend backend = { name };
+    add_blend<BlendOver>(backend, BLEND_OVER);
+    add_blend<BlendReplace>(backend, BLEND_REPLACE);
+    add_blend<BlendAdd>(backend, BLEND_ADD);
+    add_blend<BlendMultiply>(backend, BLEND_MULTIPLY);
+    add_blend<BlendScreen>(backend, BLEND_SCREEN);
+    add_blend<BlendOverLinear>(backend, BLEND_OVER_LINEAR);
+    backend.affine[SAMPLE_NEAREST][0] = affine<SampleNearest, false>;
+    backend.affine[SAMPLE_NEAREST][1] = affine<SampleNearest, true>;
+    backend.affine[SAMPLE_BILINEAR][0] = affine<SampleBilinear, false>;
+    backend.affine[SAMPLE_BILINEAR][1] = affine<SampleBilinear, true>;
+    backend.expand = expand;
+    return backend;
+}
@@ -0,0 +1,157 @@
+#include "canvas8.hpp"
+#include <limits.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// PALETTE                                                                                                          ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+u8 palette_index(Palette & palette, Color color) {
+    Pixel p = { color.r, color.g, color.b, 255 };
+    for (int i = 1; i < palette.count; ++i) {
+        Pixel c = palette.colors[i];
+        if (c.r == p.r && c.g == p.g && c.b == p.b && c.a == 255) return i;
+    }
+    if (palette.count < 256) {
+        palette.colors[palette.count] = p;
+        return palette.count++;
+    }
+
+    int best = 1, bestDist = INT_MAX;
+    for (int i = 1; i < palette.count; ++i) {
+        Pixel c = palette.colors[i];
+        int dr = c.r - p.r, dg = c.g - p.g, db = c.b - p.b;
+        int dist = dr * dr + dg * dg + db * db;
+        if (dist < bestDist) {
+            best = i;
+            bestDist = dist;
+        }
+    }
+    return best;
+}
+
+void fade_palette(Palette & dst, Palette & src, Color color) {
+    //same math as BlendOver in blit_kernels.hpp, so this matches fading the expanded canvas bit for bit
+    Pixel s = premultiply(color);
+    for (int i = 0; i < 256; ++i) {
+        Pixel d = src.colors[i];
+        dst.colors[i] = {
+            (u8) imin(255, s.r + div255(d.r * (255 - s.a))),
+            (u8) imin(255, s.g + div255(d.g * (255 - s.a))),
+            (u8) imin(255, s.b + div255(d.b * (255 - s.a))),
+            d.a,
+        };
+    }
+    dst.count = src.count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// CANVAS                                                                                                           ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Canvas8 make_canvas8(int width, int height, int margin) {
+    int canvasBytes = (width + 2 * margin) * (height + 2 * margin);
+    u8 * canvasData = (u8 *) calloc(canvasBytes + 16, 1); //slack for SIMD loads off the end of the last row
+    return {
+        canvasData + margin * (width + 2 * margin) + margin,
+        width, height, width + 2 * margin, margin, bounds(0, 0, width, height),
+        (DirtyList *) calloc(1, sizeof(DirtyList)),
+    };
+}
+
+void expand_canvas8(Canvas & dst, Canvas8 & src, Palette & palette) {
+    assert(dst.width == src.width && dst.height == src.height);
+    auto expand = [&] (Bounds b) {
+        if (empty(b)) return;
+        mark_dirty(dst, b);
+        Expand e = { &dst[b.miny][b.minx], &src[b.miny][b.minx], dst.pitch, src.pitch,
+            b.maxx - b.minx, b.maxy - b.miny, palette.colors };
+        blitBackend->expand(e);
+    };
+
+    if (src.dirty) {
+        for (int i = 0; i < src.dirty->count; ++i) {
+            expand(src.dirty->rects[i]);
+        }
+    } else {
+        expand(bounds(0, 0, src.width, src.height));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// OPS                                                                                                              ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Image8 quantize_image(Palette & palette, Image & image) {
+    int pitch = (image.width + 15) / 16 * 16;
+    Image8 out = { (u8 *) calloc(pitch * image.height + 16, 1), image.width, image.height, pitch };
+    for (int y = 0; y < image.height; ++y) {
+        for (int x = 0; x < image.width; ++x) {
+            Pixel p = image[y][x];
+            if (p.a <= 127) continue;
+            Color c = unpremultiply(p);
+            out[y][x] = palette_index(palette, { c.r, c.g, c.b, 255 });
+        }
+    }
+    return out;
+}
+
+void fill_rect(Canvas8 & canvas, int x, int y, int w, int h, u8 index) {
+    Bounds b = intersect(canvas.clip, bounds(x, y, w, h));
+    if (empty(b)) return;
+    mark_dirty(canvas, b);
+    for (int row = b.miny; row < b.maxy; ++row) {
+        memset(&canvas[row][b.minx], index, b.maxx - b.minx);
+    }
+}
+
+void draw_sprite(Canvas8 & canvas, Image8 & image, int cx, int cy) {
+    int minx = imax(canvas.clip.minx, cx);
+    int miny = imax(canvas.clip.miny, cy);
+    int maxx = imin(canvas.clip.maxx, cx + image.width);
+    int maxy = imin(canvas.clip.maxy, cy + image.height);
+    if (minx >= maxx || miny >= maxy) return;
+    mark_dirty(canvas, { minx, miny, maxx, maxy });
+
+    int w = maxx - minx;
+    for (int y = miny; y < maxy; ++y) {
+        u8 * dst = &canvas[y][minx];
+        u8 * src = &image[y - cy][minx - cx];
+        //16 pixels at a time, keeping the destination wherever the source is index 0
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m128i s = _mm_loadu_si128((__m128i *) (src + x));
+            __m128i d = _mm_loadu_si128((__m128i *) (dst + x));
+            __m128i clear = _mm_cmpeq_epi8(s, _mm_setzero_si128());
+            _mm_storeu_si128((__m128i *) (dst + x), _mm_or_si128(_mm_and_si128(clear, d), _mm_andnot_si128(clear, s)));
+        }
+        for (; x < w; ++x) {
+            if (src[x]) dst[x] = src[x];
+        }
+    }
+}
+
+void draw_text(Canvas8 & canvas, MonoFont & font, int cx, int cy, u8 index, const char * text) {
+    for (int i = 0; text[i] != '\0'; ++i) {
+        int glyph = (u8) text[i];
+        if (glyph >= font.rows * font.columns) continue;
+        MonoFont::Span span = font.spans[glyph];
+        if (span.top == span.bottom) continue;
+
+        int gx = cx + i * font.glyphWidth;
+        int minx = imax(canvas.clip.minx, gx);
+        int miny = imax(canvas.clip.miny, cy + span.top);
+        int maxx = imin(canvas.clip.maxx, gx + font.glyphWidth);
+        int maxy = imin(canvas.clip.maxy, cy + span.bottom);
+        if (minx >= maxx || miny >= maxy) continue;
+        mark_dirty(canvas, { minx, miny, maxx, maxy });
+
+        Pixel * cell = glyph_cell(font, glyph);
+        for (int y = miny; y < maxy; ++y) {
+            Pixel * src = cell + (y - cy) * font.cells.pitch;
+            u8 * dst = canvas[y];
+            for (int x = minx; x < maxx; ++x) {
+                if (src[x - gx].a > 127) dst[x] = index;
+            }
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef CANVAS8_HPP
+#define CANVAS8_HPP
+
+#include "pixel.hpp"
+
+//an indexed-color canvas, one byte per pixel looked up in a 256-entry palette, for scenes that only use a handful
+//of solid colors. drawing moves a quarter of the bytes a full-color canvas does, and the palette is only applied
+//once per frame, when expand_canvas8() turns the dirty regions into full color for presenting or recording
+//NOTE: there's no blending of any kind in indexed mode, every op writes whole palette entries. fades and other
+//      full-screen color changes are done by changing the palette instead (see fade_palette())
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// PALETTE                                                                                                          ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//NOTE: entry 0 is always opaque black, which is what new canvases (and their margins) are cleared to,
+//      and it's also the transparent index in Image8s, so palette_index() never hands it out for sprite colors
+struct Palette {
+    Pixel colors[256]; //premultiplied like everything else, though entries added by palette_index() are opaque
+    int count;
+};
+
+static inline Palette make_palette() {
+    Palette palette = {};
+    palette.colors[0] = { 0, 0, 0, 255 };
+    palette.count = 1;
+    return palette;
+}
+
+//finds the entry for an opaque color, adding it if it isn't there yet,
+//or returns the closest existing entry if the palette is already full
+u8 palette_index(Palette & palette, Color color);
+
+//blends `color` (straight alpha) over every entry of `src`, with exactly the result a BLEND_OVER rect over the whole
+//expanded canvas would have, and puts it in `dst` (which can be the same palette)
+void fade_palette(Palette & dst, Palette & src, Color color);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// CANVAS                                                                                                           ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Canvas8 {
+    u8 * pixels;
+    int width;
+    int height;
+    int pitch; //number of pixels, which for this canvas is also the number of bytes
+    int margin;
+    Bounds clip; //all draw ops are clipped to this, which must lie within [0, width) by [0, height)
+    DirtyList * dirty; //regions touched since the last clear_dirty(), or null to not track them
+
+    //NOTE: indexed in [y][x] order!!!
+    __attribute__((__always_inline__)) u8 * operator[] (int row) {
+        return pixels + row * pitch;
+    }
+};
+
+static inline void mark_dirty(Canvas8 & canvas, Bounds b) {
+    b = intersect(b, bounds(0, 0, canvas.width, canvas.height));
+    if (canvas.dirty && !empty(b)) add_dirty_rect(*canvas.dirty, b);
+}
+
+static inline void clear_dirty(Canvas8 & canvas) {
+    if (canvas.dirty) canvas.dirty->count = 0;
+}
+
+static inline void set_clip(Canvas8 & canvas, Bounds clip) {
+    canvas.clip = intersect(clip, bounds(0, 0, canvas.width, canvas.height));
+}
+
+static inline void reset_clip(Canvas8 & canvas) {
+    canvas.clip = bounds(0, 0, canvas.width, canvas.height);
+}
+
+//same layout as make_canvas(), with everything (including the margin) cleared to index 0
+Canvas8 make_canvas8(int width, int height, int margin);
+
+//looks up the dirty regions of `src` in the palette and writes them to the same place in `dst`, marking them dirty
+//there, or the whole canvas if `src` doesn't track dirty regions. this goes through the blit backend,
+//so it's a SIMD gather per few pixels rather than a lookup per pixel
+//NOTE: `dst` and `src` must be the same size, and this doesn't clear `src`'s dirty list
+void expand_canvas8(Canvas & dst, Canvas8 & src, Palette & palette);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// OPS                                                                                                              ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//a sprite for indexed canvases, where index 0 is transparent and every other index is drawn as-is
+struct Image8 {
+    u8 * pixels;
+    int width;
+    int height;
+    int pitch; //number of pixels, which is also the number of bytes
+
+    //NOTE: indexed in [y][x] order!!!
+    __attribute__((__always_inline__)) u8 * operator[] (int row) {
+        return pixels + row * pitch;
+    }
+};
+
+//maps each pixel of a full-color image to its palette entry, adding entries as needed
+//NOTE: alpha is cut to 1 bit, same as SOURCE_CUTOUT: pixels with alpha above 127 are drawn (with the
+//      unpremultiplied color), and the rest become transparent
+Image8 quantize_image(Palette & palette, Image & image);
+
+void fill_rect(Canvas8 & canvas, int x, int y, int w, int h, u8 index);
+void draw_sprite(Canvas8 & canvas, Image8 & image, int cx, int cy);
+
+//NOTE: glyph coverage is cut to 1 bit, and unlike the full-color draw_text(),
+//      this doesn't recolor '?' or error lines, since that's down to which index the caller passes
+void draw_text(Canvas8 & canvas, MonoFont & font, int cx, int cy, u8 index, const char * text);
+
+#endif //CANVAS8_HPP
@@ -0,0 +1,383 @@
+#include "draw_list.hpp"
+
+#define DRAW_BAND_HEIGHT 32
+
+static void execute(Canvas & canvas, DrawCommand & c) {
+    switch (c.op) {
+        case DRAW_BLIT: {
+            _blit(canvas, c.blit.pixels, c.blit.width, c.blit.height, c.blit.pitch, c.blit.x, c.blit.y,
+                c.blit.blend, c.blit.source, c.blit.flip, c.blit.alpha, c.color);
+        } break;
+        case DRAW_RUN_SPRITE: draw_run_sprite(canvas, *c.runs.sprite, c.runs.x, c.runs.y); break;
+        case DRAW_FILL: {
+            Bounds b = intersect(canvas.clip, bounds(c.fill.x, c.fill.y, c.fill.w, c.fill.h));
+            _fill(canvas, b, c.fill.blend, c.color);
+        } break;
+        case DRAW_OVAL: draw_oval(canvas, c.oval.x, c.oval.y, c.oval.w, c.oval.h, c.color); break;
+        case DRAW_OVAL_ADD: draw_oval_add(canvas, c.oval.x, c.oval.y, c.oval.w, c.oval.h, c.color); break;
+        case DRAW_LIGHT: add_light(canvas, c.oval.x, c.oval.y, c.oval.w, c.oval.h, c.color); break;
+        case DRAW_TRIANGLE: {
+            draw_triangle(canvas, c.triangle.x[0], c.triangle.y[0], c.triangle.x[1], c.triangle.y[1],
+                c.triangle.x[2], c.triangle.y[2], c.color);
+        } break;
+        case DRAW_TEXTURED_TRIANGLE: {
+            draw_textured_triangle(canvas, *c.triangle.tex,
+                c.triangle.x[0], c.triangle.y[0], c.triangle.u[0], c.triangle.v[0],
+                c.triangle.x[1], c.triangle.y[1], c.triangle.u[1], c.triangle.v[1],
+                c.triangle.x[2], c.triangle.y[2], c.triangle.u[2], c.triangle.v[2]);
+        } break;
+        case DRAW_TEXT: draw_text(canvas, *c.text.font, c.text.x, c.text.y, c.color, c.text.text); break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// DIFFING                                                                                                          ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//FNV-1a, fed one field at a time so that struct padding and unused union members never get hashed
+static inline void hash_bytes(u64 & hash, const void * data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ ((const u8 *) data)[i]) * 1099511628211ull;
+    }
+}
+
+template <typename TYPE>
+static inline void hash_value(u64 & hash, TYPE value) {
+    hash_bytes(hash, &value, sizeof(value));
+}
+
+u64 hash_command(DrawCommand & c) {
+    u64 hash = 14695981039346656037ull;
+    hash_value(hash, c.op);
+    hash_value(hash, c.bounds.minx);
+    hash_value(hash, c.bounds.miny);
+    hash_value(hash, c.bounds.maxx);
+    hash_value(hash, c.bounds.maxy);
+    hash_value(hash, c.color.r);
+    hash_value(hash, c.color.g);
+    hash_value(hash, c.color.b);
+    hash_value(hash, c.color.a);
+    switch (c.op) {
+        case DRAW_BLIT: {
+            //the pixel pointer alone isn't enough, a freed image's pixels can get reused for a new one
+            hash_value(hash, c.blit.serial);
+            hash_value(hash, c.blit.pixels);
+            hash_value(hash, c.blit.pitch);
+            hash_value(hash, c.blit.blend);
+            hash_value(hash, c.blit.source);
+            hash_value(hash, c.blit.flip);
+            hash_value(hash, c.blit.alpha);
+        } break;
+        case DRAW_RUN_SPRITE: {
+            hash_value(hash, c.runs.sprite->serial);
+            hash_value(hash, c.runs.sprite);
+        } break;
+        case DRAW_FILL: hash_value(hash, c.fill.blend); break;
+        case DRAW_OVAL: case DRAW_OVAL_ADD: case DRAW_LIGHT: break; //fully determined by bounds
+        case DRAW_TRIANGLE: case DRAW_TEXTURED_TRIANGLE: {
+            hash_value(hash, c.triangle.tex);
+            if (c.triangle.tex) {
+                hash_value(hash, c.triangle.tex->serial);
+                hash_value(hash, c.triangle.tex->pixels);
+            }
+            hash_bytes(hash, c.triangle.x, sizeof(c.triangle.x));
+            hash_bytes(hash, c.triangle.y, sizeof(c.triangle.y));
+            if (c.op == DRAW_TEXTURED_TRIANGLE) {
+                hash_bytes(hash, c.triangle.u, sizeof(c.triangle.u));
+                hash_bytes(hash, c.triangle.v, sizeof(c.triangle.v));
+            }
+        } break;
+        case DRAW_TEXT: {
+            //strings get hashed by content, since callers are free to reuse the buffer from frame to frame
+            hash_value(hash, c.text.font);
+            hash_bytes(hash, c.text.text, strlen(c.text.text));
+        } break;
+    }
+    return hash;
+}
+
+struct HashIndex {
+    u64 hash;
+    int index;
+};
+
+static int compare_hash_index(const void * l, const void * r) {
+    HashIndex a = *(HashIndex *) l, b = *(HashIndex *) r;
+    if (a.hash != b.hash) return a.hash < b.hash? -1 : 1;
+    return a.index - b.index;
+}
+
+//sorts the list's hashes, so two lists can be matched up in one pass
+static void sort_hashes(DrawList & list, List<HashIndex> & sorted) {
+    sorted.len = 0;
+    for (int i = 0; i < (int) list.commands.len; ++i) {
+        sorted.add({ list.commands[i].hash, i });
+    }
+    if (sorted.len) qsort(sorted.data, sorted.len, sizeof(HashIndex), compare_hash_index);
+}
+
+void diff_draw_lists(Canvas & canvas, DrawList & list, DrawList & previous) {
+    static List<HashIndex> sorted = {}, sortedPrevious = {};
+    static List<bool> matched = {}, matchedPrevious = {};
+    sort_hashes(list, sorted);
+    sort_hashes(previous, sortedPrevious);
+    matched.len = 0;
+    matchedPrevious.len = 0;
+    for (size_t i = 0; i < list.commands.len; ++i) matched.add(false);
+    for (size_t i = 0; i < previous.commands.len; ++i) matchedPrevious.add(false);
+
+    //pair up identical commands, the nth occurrence of a hash in one list with the nth in the other
+    size_t i = 0, j = 0;
+    while (i < sorted.len && j < sortedPrevious.len) {
+        if (sorted[i].hash < sortedPrevious[j].hash) {
+            ++i;
+        } else if (sorted[i].hash > sortedPrevious[j].hash) {
+            ++j;
+        } else {
+            matched[sorted[i++].index] = true;
+            matchedPrevious[sortedPrevious[j++].index] = true;
+        }
+    }
+
+    //if the commands both frames have in common are in a different order, overlapping ones may now composite
+    //differently, so just redraw everything (this only happens when the scene is restructured, which is rare)
+    i = 0, j = 0;
+    while (true) {
+        while (i < list.commands.len && !matched[i]) ++i;
+        while (j < previous.commands.len && !matchedPrevious[j]) ++j;
+        if (i == list.commands.len || j == previous.commands.len) break;
+        if (list.commands[i++].hash != previous.commands[j++].hash) {
+            mark_dirty(canvas, bounds(0, 0, canvas.width, canvas.height));
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < list.commands.len; ++i) {
+        if (!matched[i]) mark_dirty(canvas, list.commands[i].bounds);
+    }
+    for (size_t j = 0; j < previous.commands.len; ++j) {
+        if (!matchedPrevious[j]) mark_dirty(canvas, previous.commands[j].bounds);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// WORKER POOL                                                                                                      ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//runs func(data, i) for every i in [0, count), on the calling thread plus however many workers there are
+typedef void (* JobFunc) (void * data, int job);
+
+struct JobBatch {
+    JobFunc func;
+    void * data;
+    int count;
+    int next;
+};
+
+static void run_batch(JobBatch * batch) {
+    int job = __sync_fetch_and_add(&batch->next, 1);
+    while (job < batch->count) {
+        batch->func(batch->data, job);
+        job = __sync_fetch_and_add(&batch->next, 1);
+    }
+}
+
+#define MAX_WORKERS 15
+
+#if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
+#include <unistd.h>
+#include <pthread.h>
+
+//NOTE: workers sleep on `wake` between batches, and each new batch bumps `generation` so they know to pick it up
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t wake, done;
+    int workerCount, finished, generation;
+    JobBatch * batch;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, -1 };
+
+static void * worker_main(void * arg) {
+    int seen = 0;
+    pthread_mutex_lock(&pool.mutex);
+    while (true) {
+        while (pool.generation == seen) pthread_cond_wait(&pool.wake, &pool.mutex);
+        seen = pool.generation;
+        JobBatch * batch = pool.batch;
+        pthread_mutex_unlock(&pool.mutex);
+
+        run_batch(batch);
+
+        pthread_mutex_lock(&pool.mutex);
+        if (++pool.finished == pool.workerCount) pthread_cond_signal(&pool.done);
+    }
+    return NULL;
+}
+
+static void run_jobs(JobFunc func, void * data, int count) {
+    JobBatch batch = { func, data, count, 0 };
+
+    //start the pool the first time it's needed, leaving one core for the main thread
+    if (pool.workerCount < 0) {
+        pool.workerCount = 0;
+        int workers = imin(MAX_WORKERS, sysconf(_SC_NPROCESSORS_ONLN) - 1);
+        for (int i = 0; i < workers; ++i) {
+            pthread_t thread;
+            if (pthread_create(&thread, NULL, worker_main, NULL)) break;
+            pthread_detach(thread);
+            pool.workerCount += 1;
+        }
+    }
+
+    if (pool.workerCount == 0 || count < 2) {
+        run_batch(&batch);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.batch = &batch;
+    pool.finished = 0;
+    pool.generation += 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.mutex);
+
+    run_batch(&batch);
+
+    //the batch lives on our stack, so wait until every worker is done looking at it
+    pthread_mutex_lock(&pool.mutex);
+    while (pool.finished < pool.workerCount) pthread_cond_wait(&pool.done, &pool.mutex);
+    pthread_mutex_unlock(&pool.mutex);
+}
+#elif defined (_WIN32)
+#include <windows.h>
+
+//same scheme as the pthreads version above, with slim reader/writer locks and condition variables (Vista and up)
+static struct {
+    SRWLOCK lock;
+    CONDITION_VARIABLE wake, done;
+    int workerCount, finished, generation;
+    JobBatch * batch;
+} pool = { SRWLOCK_INIT, CONDITION_VARIABLE_INIT, CONDITION_VARIABLE_INIT, -1 };
+
+static DWORD WINAPI worker_main(void * arg) {
+    int seen = 0;
+    AcquireSRWLockExclusive(&pool.lock);
+    while (true) {
+        while (pool.generation == seen) SleepConditionVariableSRW(&pool.wake, &pool.lock, INFINITE, 0);
+        seen = pool.generation;
+        JobBatch * batch = pool.batch;
+        ReleaseSRWLockExclusive(&pool.lock);
+
+        run_batch(batch);
+
+        AcquireSRWLockExclusive(&pool.lock);
+        if (++pool.finished == pool.workerCount) WakeConditionVariable(&pool.done);
+    }
+    return 0;
+}
+
+static void run_jobs(JobFunc func, void * data, int count) {
+    JobBatch batch = { func, data, count, 0 };
+
+    //start the pool the first time it's needed, leaving one core for the main thread
+    if (pool.workerCount < 0) {
+        pool.workerCount = 0;
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        int workers = imin(MAX_WORKERS, (int) info.dwNumberOfProcessors - 1);
+        for (int i = 0; i < workers; ++i) {
+            HANDLE thread = CreateThread(NULL, 0, worker_main, NULL, 0, NULL);
+            if (!thread) break;
+            CloseHandle(thread);
+            pool.workerCount += 1;
+        }
+    }
+
+    if (pool.workerCount == 0 || count < 2) {
+        run_batch(&batch);
+        return;
+    }
+
+    AcquireSRWLockExclusive(&pool.lock);
+    pool.batch = &batch;
+    pool.finished = 0;
+    pool.generation += 1;
+    WakeAllConditionVariable(&pool.wake);
+    ReleaseSRWLockExclusive(&pool.lock);
+
+    run_batch(&batch);
+
+    //the batch lives on our stack, so wait until every worker is done looking at it
+    AcquireSRWLockExclusive(&pool.lock);
+    while (pool.finished < pool.workerCount) SleepConditionVariableSRW(&pool.done, &pool.lock, INFINITE, 0);
+    ReleaseSRWLockExclusive(&pool.lock);
+}
+#else
+//no threads on other platforms, so the jobs just run one after another on the calling thread
+static void run_jobs(JobFunc func, void * data, int count) {
+    JobBatch batch = { func, data, count, 0 };
+    run_batch(&batch);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// RENDERING                                                                                                        ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct RenderJobs {
+    Canvas * canvas;
+    DrawList * list;
+    List<Bounds> areas; //each job renders one of these, which is a rect clipped to a band
+    List<int> bands; //which band each area is in
+};
+
+static void render_job(void * data, int job) {
+    RenderJobs * jobs = (RenderJobs *) data;
+    Bounds area = jobs->areas[job];
+
+    //draw into a copy of the canvas, so that the clip rect is our own and nothing writes to the dirty list
+    Canvas canvas = *jobs->canvas;
+    canvas.clip = area;
+    canvas.dirty = nullptr;
+
+    for (int index : jobs->list->bins[jobs->bands[job]]) {
+        DrawCommand & command = jobs->list->commands[index];
+        if (overlaps(command.bounds, area)) execute(canvas, command);
+    }
+}
+
+void render_draw_list(Canvas & canvas, DrawList & list, Bounds * rects, int rectCount) {
+    //bin the commands by band, in order
+    int bandCount = (canvas.height + DRAW_BAND_HEIGHT - 1) / DRAW_BAND_HEIGHT;
+    if (list.binCount < bandCount) {
+        list.bins = (List<int> *) realloc(list.bins, bandCount * sizeof(List<int>));
+        for (int i = list.binCount; i < bandCount; ++i) list.bins[i] = {};
+        list.binCount = bandCount;
+    }
+    for (int i = 0; i < bandCount; ++i) {
+        list.bins[i].len = 0;
+    }
+    for (int i = 0; i < (int) list.commands.len; ++i) {
+        Bounds b = intersect(list.commands[i].bounds, bounds(0, 0, canvas.width, canvas.height));
+        if (empty(b)) continue;
+        for (int band = b.miny / DRAW_BAND_HEIGHT; band <= (b.maxy - 1) / DRAW_BAND_HEIGHT; ++band) {
+            list.bins[band].add(i);
+        }
+    }
+
+    //one job per piece of each rect that falls within a band
+    static RenderJobs jobs = {};
+    jobs.canvas = &canvas;
+    jobs.list = &list;
+    jobs.areas.len = 0;
+    jobs.bands.len = 0;
+    for (int i = 0; i < rectCount; ++i) {
+        Bounds rect = intersect(rects[i], bounds(0, 0, canvas.width, canvas.height));
+        if (empty(rect)) continue;
+        for (int band = rect.miny / DRAW_BAND_HEIGHT; band <= (rect.maxy - 1) / DRAW_BAND_HEIGHT; ++band) {
+            jobs.areas.add(intersect(rect, bounds(0, band * DRAW_BAND_HEIGHT, canvas.width, DRAW_BAND_HEIGHT)));
+            jobs.bands.add(band);
+        }
+    }
+
+    run_jobs(render_job, &jobs, jobs.areas.len);
+}
@@ -0,0 +1,154 @@
+#ifndef DRAW_LIST_HPP
+#define DRAW_LIST_HPP
+
+#include "pixel.hpp"
+#include "List.hpp"
+
+//a frame's worth of draw ops, recorded so they can be diffed against the last frame's with diff_draw_lists()
+//and rasterized in parallel by render_draw_list()
+//NOTE: everything a command points to (images, fonts, strings) has to stay alive until it has been rendered
+//NOTE: images are identified by their serial and pixel pointer, so their contents must not change
+//      while they're being drawn, and images put together by hand (serial 0) mustn't reuse another's freed pixels
+
+enum DrawOp {
+    DRAW_BLIT,
+    DRAW_RUN_SPRITE,
+    DRAW_FILL,
+    DRAW_OVAL,
+    DRAW_OVAL_ADD,
+    DRAW_LIGHT,
+    DRAW_TRIANGLE,
+    DRAW_TEXTURED_TRIANGLE,
+    DRAW_TEXT,
+};
+
+struct DrawCommand {
+    DrawOp op;
+    Bounds bounds; //everything the command could possibly touch, used for binning
+    Color color;
+    u64 hash; //of everything that affects the command's output, filled in by push_command()
+    union {
+        struct { Pixel * pixels; int width, height, pitch; u32 serial; int x, y; BlendMode blend; SourceMode source;
+                 bool flip; float alpha; } blit;
+        struct { RunSprite * sprite; int x, y; } runs;
+        struct { int x, y, w, h; BlendMode blend; } fill;
+        struct { int x, y, w, h; } oval;
+        struct { Image * tex; int x[3], y[3], u[3], v[3]; } triangle;
+        struct { MonoFont * font; const char * text; int x, y; } text;
+    };
+};
+
+struct DrawList {
+    List<DrawCommand> commands;
+    List<int> * bins; //indices of the commands overlapping each band, filled in by render_draw_list()
+    int binCount;
+};
+
+static inline void clear_draw_list(DrawList & list) {
+    list.commands.len = 0;
+}
+
+u64 hash_command(DrawCommand & command);
+
+static inline void push_command(DrawList & list, DrawCommand command) {
+    if (empty(command.bounds)) return;
+    command.hash = hash_command(command);
+    list.commands.add(command);
+}
+
+static inline void push_blit(DrawList & list, Image & image, int cx, int cy,
+    BlendMode blend, SourceMode source, bool flip = false, float alpha = 1, Color color = {})
+{
+    DrawCommand command = { DRAW_BLIT, bounds(cx, cy, image.width, image.height), color };
+    command.blit = { image.pixels, image.width, image.height, image.pitch, image.serial, cx, cy,
+                     blend, source, flip, alpha };
+    push_command(list, command);
+}
+
+static inline void push_sprite(DrawList & list, Image & image, int cx, int cy) {
+    push_blit(list, image, cx, cy, BLEND_OVER, SOURCE_COPY);
+}
+
+static inline void push_sprite_a1(DrawList & list, Image & image, int cx, int cy) {
+    push_blit(list, image, cx, cy, BLEND_REPLACE, SOURCE_CUTOUT);
+}
+
+static inline void push_text_strip(DrawList & list, Image & strip, int cx, int cy) {
+    push_blit(list, strip, cx, cy, BLEND_OVER, SOURCE_CUTOUT);
+}
+
+static inline void push_run_sprite(DrawList & list, RunSprite & sprite, int cx, int cy) {
+    DrawCommand command = { DRAW_RUN_SPRITE, bounds(cx, cy, sprite.image.width, sprite.image.height) };
+    command.runs = { &sprite, cx, cy };
+    push_command(list, command);
+}
+
+static inline void push_rect(DrawList & list, int x, int y, int w, int h, Color color) {
+    if (color.a == 0) return;
+    DrawCommand command = { DRAW_FILL, bounds(x, y, w, h), color };
+    command.fill = { x, y, w, h, BLEND_OVER };
+    push_command(list, command);
+}
+
+static inline void push_fill_rect(DrawList & list, int x, int y, int w, int h, Color color) {
+    DrawCommand command = { DRAW_FILL, bounds(x, y, w, h), color };
+    command.fill = { x, y, w, h, BLEND_REPLACE };
+    push_command(list, command);
+}
+
+static inline void _push_oval(DrawList & list, DrawOp op, int x0, int y0, int w, int h, Color color) {
+    DrawCommand command = { op, { x0 - w, y0 - h, x0 + w, y0 + h }, color };
+    command.oval = { x0, y0, w, h };
+    push_command(list, command);
+}
+
+static inline void push_oval(DrawList & list, int x0, int y0, int w, int h, Color color) {
+    _push_oval(list, DRAW_OVAL, x0, y0, w, h, color);
+}
+
+static inline void push_oval_add(DrawList & list, int x0, int y0, int w, int h, Color color) {
+    _push_oval(list, DRAW_OVAL_ADD, x0, y0, w, h, color);
+}
+
+static inline void push_light(DrawList & list, int x0, int y0, int w, int h, Color color) {
+    _push_oval(list, DRAW_LIGHT, x0, y0, w, h, color);
+}
+
+static inline void push_triangle(DrawList & list, int x1, int y1, int x2, int y2, int x3, int y3, Color c) {
+    DrawCommand command = { DRAW_TRIANGLE, { imin(x1, imin(x2, x3)), imin(y1, imin(y2, y3)),
+                                             imax(x1, imax(x2, x3)) + 1, imax(y1, imax(y2, y3)) + 1 }, c };
+    command.triangle = { nullptr, { x1, x2, x3 }, { y1, y2, y3 } };
+    push_command(list, command);
+}
+
+static inline void push_textured_triangle(DrawList & list, Image & tex,
+    int x1, int y1, int u1, int v1,
+    int x2, int y2, int u2, int v2,
+    int x3, int y3, int u3, int v3)
+{
+    DrawCommand command = { DRAW_TEXTURED_TRIANGLE, { imin(x1, imin(x2, x3)), imin(y1, imin(y2, y3)),
+                                                      imax(x1, imax(x2, x3)) + 1, imax(y1, imax(y2, y3)) + 1 } };
+    command.triangle = { &tex, { x1, x2, x3 }, { y1, y2, y3 }, { u1, u2, u3 }, { v1, v2, v3 } };
+    push_command(list, command);
+}
+
+static inline void push_text(DrawList & list, MonoFont & font, int cx, int cy, Color color, const char * text) {
+    DrawCommand command = { DRAW_TEXT, bounds(cx, cy, strlen(text) * font.glyphWidth, font.glyphHeight * 2), color };
+    command.text = { &font, text, cx, cy };
+    push_command(list, command);
+}
+
+//marks the canvas dirty wherever drawing `list` could give different pixels than drawing `previous` did,
+//which is the bounds of every command that was added or removed, or everything if the common commands got reordered
+//NOTE: the dirty regions get redrawn by replaying `list` over last frame's pixels, so this only works
+//      for scenes that paint every pixel from scratch (i.e. start by filling the canvas with something opaque)
+void diff_draw_lists(Canvas & canvas, DrawList & list, DrawList & previous);
+
+//renders the commands into each of `rects` (which must not overlap), splitting the work
+//into horizontal bands that are rasterized in parallel on a persistent pool of worker threads
+//NOTE: every pixel sees the commands in the order they were recorded, so the result is identical to drawing
+//      them one after another on a single thread, and doesn't depend on how many threads there are
+//NOTE: this doesn't mark anything dirty, because the rects being rendered are assumed to be dirty already
+void render_draw_list(Canvas & canvas, DrawList & list, Bounds * rects, int rectCount);
+
+#endif //DRAW_LIST_HPP
@@ -58,6 +58,12 @@ static FileBuffer create_file_buffer(size_t bytes) {
 #include <emmintrin.h>
 #endif
 
+//scales an 8-bit channel to 16 bits, leaving room for the dither offset below the top `bits` bits
+static inline int channel_mul(int bits) {
+    int diff = (1 << (8 - bits)) - 1;
+    return (255.0f - diff) / 255.0f * 257;
+}
+
 static CookedFrame cook_frame(int width, int height, int pitchInBytes, int maxBitDepth, uint8_t * raw) {
     //bit depth for each channel
     const static int rbitdepths[13] = { 5, 5, 4, 4, 4, 3, 3, 3, 2, 2, 2, 1, 1 };
@@ -74,18 +80,63 @@ static CookedFrame cook_frame(int width, int height, int pitchInBytes, int maxBi
 
     bool * used = (bool *) malloc((1 << 15) * sizeof(bool));
     uint32_t * cooked = (uint32_t *) malloc(width * height * sizeof(uint32_t));
+
+    //skip straight past the bit depths that can't possibly fit in 256 colors, using a histogram of the frame
+    //at 5 bits per channel, so colorful frames don't get cooked over and over at every bit depth in between
+    //NOTE: each histogram bucket keeps the first real pixel that landed in it (and where it was, for the dither),
+    //      which gets cooked exactly like the loop below would cook it. so the count for each depth is the number
+    //      of colors some of the frame's own pixels need, which can only be less than what the whole frame needs,
+    //      never more, and the search never skips a depth the full count would have accepted. the loop below
+    //      still counts the real colors after cooking, and moves on to the next depth if there are too many
+    {
+        memset(used, 0, (1 << 15) * sizeof(bool));
+        //the cooked buffer isn't needed yet, so the bucket representatives go there,
+        //with the pixel's place in the dither kernel in place of its alpha
+        //NOTE: every other pixel of every other row is plenty to tell which depths are hopeless,
+        //      at a quarter of the cost
+        int colors = 0;
+        for (int y = 0; y < height; y += 2) {
+            for (int x = 0; x < width; x += 2) {
+                uint32_t p;
+                memcpy(&p, &raw[y * pitchInBytes + x * 4], 4);
+                int bucket = (p >> 3 & 0x1F) | (p >> 6 & 0x3E0) | (p >> 9 & 0x7C00);
+                if (used[bucket]) continue;
+                used[bucket] = true;
+                cooked[colors++] = (p & 0xFFFFFF) | (uint32_t) ((y & 3) * 4 + (x & 3)) << 24;
+            }
+        }
+
+        for (; pal < 12; ++pal) {
+            int rbits = rbitdepths[pal], gbits = gbitdepths[pal], bbits = bbitdepths[pal];
+            int rmul = channel_mul(rbits), gmul = channel_mul(gbits), bmul = channel_mul(bbits);
+            int gmask = ((1 << gbits) - 1) << rbits;
+            int bmask = ((1 << bbits) - 1) << rbits << gbits;
+            memset(used, 0, (1 << (rbits + gbits + bbits)) * sizeof(bool));
+            int count = 0;
+            for (int i = 0; i < colors && count < 256; ++i) {
+                //same as the scalar cleanup loop below
+                uint32_t p = cooked[i];
+                int k = ditherKernel[p >> 24];
+                int c =
+                    (min(65535, (p >> 16 & 0xFF) * bmul + (k >> bbits)) >> (16 - rbits - gbits - bbits) & bmask) |
+                    (min(65535, (p >>  8 & 0xFF) * gmul + (k >> gbits)) >> (16 - rbits - gbits        ) & gmask) |
+                     min(65535, (p       & 0xFF) * rmul + (k >> rbits)) >> (16 - rbits                );
+                count += !used[c];
+                used[c] = true;
+            }
+            if (count < 256) break;
+        }
+    }
+
     int count = 0;
     do {
         int rbits = rbitdepths[pal], gbits = gbitdepths[pal], bbits = bbitdepths[pal];
         int paletteSize = 1 << (rbits + gbits + bbits);
         memset(used, 0, paletteSize * sizeof(bool));
 
-        int rdiff = (1 << (8 - rbits)) - 1;
-        int gdiff = (1 << (8 - gbits)) - 1;
-        int bdiff = (1 << (8 - bbits)) - 1;
-        int rmul = (255.0f - rdiff) / 255.0f * 257;
-        int gmul = (255.0f - gdiff) / 255.0f * 257;
-        int bmul = (255.0f - bdiff) / 255.0f * 257;
+        int rmul = channel_mul(rbits);
+        int gmul = channel_mul(gbits);
+        int bmul = channel_mul(bbits);
 
         int gmask = ((1 << gbits) - 1) << rbits;
         int bmask = ((1 << bbits) - 1) << rbits << gbits;
@@ -174,34 +225,103 @@ static inline void put_code(FileBuffer * buf, BlockBuffer * block, int bits, uin
     }
 }
 
+//maps (prefix code, next index) pairs to the code for the combined string, as an open-addressing hash table
+//NOTE: entries are tagged with the generation of the code table they belong to, so resetting the code table
+//      (which happens every ~4000 codes) only bumps the generation, and entries from older ones count as empty
+#define LZW_HASH_BITS 13 //twice as many slots as there can be codes, so probe sequences stay short
 typedef struct {
-    int16_t * data;
-    size_t len;
-    size_t stride;
-} StridedList;
-
-static inline void reset(StridedList * lzw, int tableSize, int stride) {
-    memset(lzw->data, 0xFF, 4096 * stride * sizeof(int16_t));
+    uint32_t keys[1 << LZW_HASH_BITS]; //generation << 20 | prefix << 8 | index, where generation 0 means empty
+    int16_t codes[1 << LZW_HASH_BITS];
+    uint32_t generation;
+    int len; //number of codes in the code table so far
+} LzwDict;
+
+static inline void reset(LzwDict * lzw, int tableSize) {
+    //generations have 12 bits, so the keys only need to actually be cleared once every 4095 resets
+    if (++lzw->generation == 1 << 12) {
+        memset(lzw->keys, 0, sizeof(lzw->keys));
+        lzw->generation = 1;
+    }
     lzw->len = tableSize + 2;
-    lzw->stride = stride;
+}
+
+static inline uint32_t lzw_key(LzwDict * lzw, int prefix, int index) {
+    return lzw->generation << 20 | prefix << 8 | index;
+}
+
+//returns the slot holding `key`, or the empty slot where it would go
+static inline int find_slot(LzwDict * lzw, uint32_t key) {
+    int slot = (key & 0xFFFFF) * 0x9E3779B1u >> (32 - LZW_HASH_BITS);
+    while (lzw->keys[slot] != key && lzw->keys[slot] >> 20 == lzw->generation) {
+        slot = (slot + 1) & ((1 << LZW_HASH_BITS) - 1);
+    }
+    return slot;
 }
 
 static FileBuffer compress_frame(int width, int height, int centiSeconds, CookedFrame frame, CookedFrame previous)
 {
     FileBuffer buf = create_file_buffer(1024);
-    StridedList lzw = { (int16_t *) malloc(4096 * 256 * sizeof(int16_t)) };
+    LzwDict lzw; //48k, so stack allocating is fine too, and it stays in cache
+    memset(lzw.keys, 0, sizeof(lzw.keys));
+    lzw.generation = 0;
+
+    //pixels can only be compared with the previous frame's if they mean the same colors
+    bool diff = frame.palette? previous.palette && !memcmp(frame.palette, previous.palette, 256 * 3) :
+        !previous.palette && frame.rbits == previous.rbits && frame.gbits == previous.gbits && frame.bbits == previous.bbits;
+
+    //only the box around the pixels that changed since the previous frame gets encoded, the rest is left showing
+    //through, which for mostly static content skips nearly all of the LZW work (and nearly all of the output)
+    int left = 0, top = 0, right = width, bottom = height;
+    if (diff) {
+        left = width, top = height, right = 0, bottom = 0;
+        for (int y = 0; y < height; ++y) {
+            uint32_t * row = &frame.pixels[y * width];
+            uint32_t * prev = &previous.pixels[y * width];
+            if (!memcmp(row, prev, width * sizeof(uint32_t))) continue;
+            int x0 = 0, x1 = width;
+            while (row[x0] == prev[x0]) ++x0;
+            while (row[x1 - 1] == prev[x1 - 1]) --x1;
+            left = min(left, x0);
+            right = max(right, x1);
+            top = min(top, y);
+            bottom = y + 1;
+        }
+
+        //gifs can't have empty frames, so a frame with no changes is a single transparent pixel
+        if (top == height) {
+            left = top = 0;
+            right = bottom = 1;
+        }
+    }
 
     //allocate tlb
     int totalBits = frame.rbits + frame.gbits + frame.bbits;
-    int tlbSize = 1 << totalBits;
+    int tlbSize = frame.palette? 256 : 1 << totalBits;
     uint8_t tlb[1 << 15]; //only 32k, so stack allocating is fine
 
+    //the color table only needs the colors of pixels that are actually encoded
+    bool boxUsed[1 << 15];
+    const bool * used = frame.used;
+    if (diff) {
+        memset(boxUsed, 0, tlbSize * sizeof(bool));
+        for (int y = top; y < bottom; ++y) {
+            for (int x = left; x < right; ++x) {
+                int i = y * width + x;
+                if (frame.pixels[i] != previous.pixels[i]) boxUsed[frame.pixels[i]] = true;
+            }
+        }
+        used = boxUsed;
+    }
+
     //generate palette
     typedef struct { uint8_t r, g, b; } Color3;
     Color3 table[256] = {};
     int tableIdx = 1; //we start counting at 1 because 0 is the transparent color
     for (int i = 0; i < tlbSize; ++i) {
-        if (frame.used[i]) {
+        if (used[i] && frame.palette) {
+            tlb[i] = tableIdx;
+            table[tableIdx++] = (Color3) { frame.palette[i * 3 + 0], frame.palette[i * 3 + 1], frame.palette[i * 3 + 2] };
+        } else if (used[i]) {
             tlb[i] = tableIdx;
             int rmask = (1 << frame.rbits) - 1;
             int gmask = (1 << frame.gbits) - 1;
@@ -221,9 +341,10 @@ static FileBuffer compress_frame(int width, int height, int centiSeconds, Cooked
         }
     }
 
-    int tableBits = bit_log(tableIdx - 1);
+    //NOTE: the gif spec doesn't allow an LZW minimum code size below 2, even for 1-bit images, and frames with
+    //      no changes (or only one changed color) are common now that only the changed box gets encoded
+    int tableBits = max(2, bit_log(max(1, tableIdx - 1)));
     int tableSize = 1 << tableBits;
-    bool diff = frame.rbits == previous.rbits && frame.gbits == previous.gbits && frame.bbits == previous.bbits;
 
     struct __attribute__((__packed__)) {
         //graphics control extension
@@ -239,8 +360,10 @@ static FileBuffer compress_frame(int width, int height, int centiSeconds, Cooked
         0x2C, 0, 0, 0, 0, 0x80,
     };
     header.centiSeconds = centiSeconds;
-    header.width = width;
-    header.height = height;
+    header.left = left;
+    header.top = top;
+    header.width = right - left;
+    header.height = bottom - top;
     header.imgFlags |= tableBits - 1;
     write_data(&buf, &header, sizeof(header));
 
@@ -258,38 +381,43 @@ static FileBuffer compress_frame(int width, int height, int centiSeconds, Cooked
     //image data
     BlockBuffer block = {};
     write_u8(&buf, tableBits);
-    reset(&lzw, tableSize, tableIdx);
-
-    uint8_t idxBuffer[4096];
-    int idxLen = 0;
-    int lastCode = diff && frame.pixels[0] == previous.pixels[0]? 0 : tlb[frame.pixels[0]];
-    for (int i = 1; i < width * height; ++i) {
-        idxBuffer[idxLen++] = diff && frame.pixels[i] == previous.pixels[i]? 0 : tlb[frame.pixels[i]];
-        int code = (&lzw.data[lastCode * lzw.stride])[idxBuffer[idxLen - 1]];
-        if (code < 0) {
-            //write to code stream
-            int codeBits = bit_log(lzw.len - 1);
-            put_code(&buf, &block, codeBits, lastCode);
-
-            //NOTE: [I THINK] we need to leave room for 2 more codes (leftover and end code)
-            //      because we don't ever reset the table after writing the leftover bits
-            //XXX: is my thinking correct on this one?
-            if (lzw.len > 4094) {
-                //reset buffer code table
-                put_code(&buf, &block, codeBits, tableSize);
-                reset(&lzw, tableSize, tableIdx);
-            } else {
-                (&lzw.data[lastCode * lzw.stride])[idxBuffer[idxLen - 1]] = lzw.len;
-                ++lzw.len;
+    reset(&lzw, tableSize);
+
+    int lastCode = -1;
+    for (int y = top; y < bottom; ++y) {
+        for (int x = left; x < right; ++x) {
+            int i = y * width + x;
+            int idx = diff && frame.pixels[i] == previous.pixels[i]? 0 : tlb[frame.pixels[i]];
+            if (lastCode < 0) {
+                lastCode = idx;
+                continue;
             }
 
-            //reset index buffer
-            idxBuffer[0] = idxBuffer[idxLen - 1];
-            idxLen = 1;
+            uint32_t key = lzw_key(&lzw, lastCode, idx);
+            int slot = find_slot(&lzw, key);
+            int code = lzw.keys[slot] == key? lzw.codes[slot] : -1;
+            if (code < 0) {
+                //write to code stream
+                int codeBits = bit_log(lzw.len - 1);
+                put_code(&buf, &block, codeBits, lastCode);
+
+                //NOTE: [I THINK] we need to leave room for 2 more codes (leftover and end code)
+                //      because we don't ever reset the table after writing the leftover bits
+                //XXX: is my thinking correct on this one?
+                if (lzw.len > 4094) {
+                    //reset buffer code table
+                    put_code(&buf, &block, codeBits, tableSize);
+                    reset(&lzw, tableSize);
+                } else {
+                    lzw.keys[slot] = key;
+                    lzw.codes[slot] = lzw.len;
+                    ++lzw.len;
+                }
 
-            lastCode = idxBuffer[0];
-        } else {
-            lastCode = code;
+                lastCode = idx;
+            } else {
+                lastCode = code;
+            }
         }
     }
 
@@ -308,7 +436,6 @@ static FileBuffer compress_frame(int width, int height, int centiSeconds, Cooked
     check(&buf, 1);
     write_u8(&buf, 0); //terminating block
 
-    free(lzw.data);
     return buf;
 }
 
@@ -351,130 +478,447 @@ size_t msf_gif_begin(MsfGifState * state, const char * path, int width, int heig
     return max(0, ftell(state->fp));
 }
 
-size_t msf_gif_frame(MsfGifState * state,
-    uint8_t * pixels, int pitchInBytes, int centiSeconds, int maxBitDepth, bool upsideDown)
-{
-    if (upsideDown) pitchInBytes *= -1;
-    uint8_t * raw = upsideDown? &pixels[state->width * 4 * (state->height - 1)] : pixels;
-    CookedFrame frame = cook_frame(state->width, state->height, pitchInBytes, maxBitDepth, raw);
+static void free_cooked_frame(CookedFrame frame) {
+    free(frame.pixels);
+    free(frame.used);
+    free(frame.palette);
+}
+
+//compresses and writes the frame, which then becomes the previous frame
+static size_t write_frame(MsfGifState * state, CookedFrame frame, int centiSeconds) {
     FileBuffer buf = compress_frame(state->width, state->height, centiSeconds, frame, state->previousFrame);
     fwrite(buf.block, buf.head - buf.block, 1, state->fp);
     free(buf.block);
-    free(frame.used);
-    free(state->previousFrame.pixels);
+    free_cooked_frame(state->previousFrame);
     state->previousFrame = frame;
     return max(0, ftell(state->fp));
 }
 
+size_t msf_gif_frame(MsfGifState * state,
+    uint8_t * pixels, int pitchInBytes, int centiSeconds, int maxBitDepth, bool upsideDown)
+{
+    uint8_t * raw = upsideDown? &pixels[pitchInBytes * (state->height - 1)] : pixels;
+    if (upsideDown) pitchInBytes *= -1;
+    return write_frame(state, cook_frame(state->width, state->height, pitchInBytes, maxBitDepth, raw), centiSeconds);
+}
+
+size_t msf_gif_frame_indexed(MsfGifState * state, uint8_t * indices, int pitchInBytes, const uint8_t * paletteRGBA,
+    int centiSeconds)
+{
+    int width = state->width, height = state->height;
+    bool * used = (bool *) calloc(256, sizeof(bool));
+    uint32_t * pixels = (uint32_t *) malloc(width * height * sizeof(uint32_t));
+    int count = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t i = indices[y * pitchInBytes + x];
+            pixels[y * width + x] = i;
+            count += !used[i];
+            used[i] = true;
+        }
+    }
+
+    //index 0 of the local color table is taken by the transparent color, so only 255 entries are left
+    if (count == 256) {
+        uint32_t * rgba = (uint32_t *) malloc(width * height * sizeof(uint32_t));
+        for (int i = 0; i < width * height; ++i) {
+            memcpy(&rgba[i], &paletteRGBA[pixels[i] * 4], 4);
+        }
+        free(used);
+        free(pixels);
+        size_t ret = msf_gif_frame(state, (uint8_t *) rgba, width * 4, centiSeconds, 15, false);
+        free(rgba);
+        return ret;
+    }
+
+    uint8_t * palette = (uint8_t *) malloc(256 * 3);
+    for (int i = 0; i < 256; ++i) {
+        memcpy(&palette[i * 3], &paletteRGBA[i * 4], 3);
+    }
+    return write_frame(state, (CookedFrame) { pixels, used, 0, 0, 0, palette }, centiSeconds);
+}
+
 size_t msf_gif_end(MsfGifState * state) {
     uint8_t trailingMarker = 0x3B;
     fwrite(&trailingMarker, 1, 1, state->fp);
     size_t bytesWritten = ftell(state->fp);
     fclose(state->fp);
-    free(state->previousFrame.pixels);
+    free_cooked_frame(state->previousFrame);
     return bytesWritten;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Non-Incremental API                                                      ///
+/// Encoding Pipeline                                                        ///
 ////////////////////////////////////////////////////////////////////////////////
 
-struct CookThreadData { //TODO: rename to reflect its new use
-    uint8_t ** frames;
-    CookedFrame * cooked;
-    FileBuffer * buffers;
-    int frameCount, width, height, centiSeconds, maxBitDepth;
-    bool upsideDown;
-    int frameIdx;
-};
-
-//TODO: define atomic_post_inc() based on compiler detection
-//      and disable multithreading if we're on an undetected compiler
-
-static void * thread_cook_frames(void * arg) {
-    CookThreadData * data = (CookThreadData *) arg;
-    int frameIdx = __sync_fetch_and_add(&data->frameIdx, 1);
-    while (frameIdx < data->frameCount) {
-        uint8_t * pixels = data->frames[frameIdx];
-        int pitchInBytes = data->upsideDown? -data->width * 4 : data->width * 4;
-        uint8_t * raw = data->upsideDown? &pixels[data->width * 4 * (data->height - 1)] : pixels;
-        data->cooked[frameIdx] = cook_frame(data->width, data->height, pitchInBytes, data->maxBitDepth, raw);
-        frameIdx = __sync_fetch_and_add(&data->frameIdx, 1);
-    }
-    return NULL;
-}
-
-static void * thread_compress_frames(void * arg) {
-    CookThreadData * data = (CookThreadData *) arg;
-    int frameIdx = __sync_fetch_and_add(&data->frameIdx, 1);
-    while (frameIdx < data->frameCount) {
-        CookedFrame prev = frameIdx == 0? (CookedFrame) {} : data->cooked[frameIdx - 1];
-        data->buffers[frameIdx] =
-            compress_frame(data->width, data->height, data->centiSeconds, data->cooked[frameIdx], prev);
-        frameIdx = __sync_fetch_and_add(&data->frameIdx, 1);
-    }
-    return NULL;
-}
+//shared by the all-at-once and asynchronous APIs: frames are queued from one thread, and encoded and written
+//by a pool of workers, with at most `window` frames in flight at a time
 
 #define MAX_THREADS 64
+#define RECORDER_POOL 8 //raw frame buffers for frames that get copied when queued, allocated as needed
 
+//the pipeline only needs a mutex, condition variables and joinable threads, so each platform just wraps its own
 #if defined (__unix__) || (defined (__APPLE__) && defined (__MACH__))
 #include <unistd.h>
 #include <pthread.h>
+#define HAS_THREADS
+
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+typedef pthread_t Thread;
+
+static inline void mutex_init(Mutex * mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void mutex_destroy(Mutex * mutex) { pthread_mutex_destroy(mutex); }
+static inline void mutex_lock(Mutex * mutex) { pthread_mutex_lock(mutex); }
+static inline void mutex_unlock(Mutex * mutex) { pthread_mutex_unlock(mutex); }
+static inline void cond_init(Cond * cond) { pthread_cond_init(cond, NULL); }
+static inline void cond_destroy(Cond * cond) { pthread_cond_destroy(cond); }
+static inline void cond_wait(Cond * cond, Mutex * mutex) { pthread_cond_wait(cond, mutex); }
+static inline void cond_broadcast(Cond * cond) { pthread_cond_broadcast(cond); }
+static inline int core_count() { return sysconf(_SC_NPROCESSORS_ONLN); }
+
+static void recorder_thread(MsfGifRecorder * rec);
+static void * thread_main(void * arg) {
+    recorder_thread((MsfGifRecorder *) arg);
+    return NULL;
+}
 
-static void fork_join(void * (* func) (void *), void * data, int maxThreads) {
-    int poolSize = min(MAX_THREADS, min(maxThreads, sysconf(_SC_NPROCESSORS_ONLN))) - 1;
-    pthread_t threads[MAX_THREADS] = {};
-
+static inline bool start_thread(Thread * thread, MsfGifRecorder * rec) {
     //we have to create a pthread_attr_t to ensure that the threads will be joinable,
     //because threads are not guaranteed to be joinable by default according to the standard
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    for (int i = 0; i < poolSize; ++i) {
-        pthread_create(&threads[i], &attr, func, data);
-    }
+    bool ok = !pthread_create(thread, &attr, thread_main, rec);
     pthread_attr_destroy(&attr);
-    func(data);
-    for (int i = 0; i < poolSize; ++i) {
-        pthread_join(threads[i], NULL);
-    }
+    return ok;
 }
+
+static inline void join_thread(Thread thread) { pthread_join(thread, NULL); }
 #elif defined (_WIN32)
-//TODO: windows version of the above function
-static void fork_join(void * (* func) (void *), void * data, int maxThreads) { func(data); }
-#else
-static void fork_join(void * (* func) (void *), void * data, int maxThreads) { func(data); }
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX //we have our own min() and max()
+#include <windows.h>
+#define HAS_THREADS
+
+//slim reader/writer locks and condition variables, which need Vista or later
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Cond;
+typedef HANDLE Thread;
+
+static inline void mutex_init(Mutex * mutex) { InitializeSRWLock(mutex); }
+static inline void mutex_destroy(Mutex * mutex) {}
+static inline void mutex_lock(Mutex * mutex) { AcquireSRWLockExclusive(mutex); }
+static inline void mutex_unlock(Mutex * mutex) { ReleaseSRWLockExclusive(mutex); }
+static inline void cond_init(Cond * cond) { InitializeConditionVariable(cond); }
+static inline void cond_destroy(Cond * cond) {}
+static inline void cond_wait(Cond * cond, Mutex * mutex) { SleepConditionVariableSRW(cond, mutex, INFINITE, 0); }
+static inline void cond_broadcast(Cond * cond) { WakeAllConditionVariable(cond); }
+static inline int core_count() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+static void recorder_thread(MsfGifRecorder * rec);
+static DWORD WINAPI thread_main(void * arg) {
+    recorder_thread((MsfGifRecorder *) arg);
+    return 0;
+}
+
+static inline bool start_thread(Thread * thread, MsfGifRecorder * rec) {
+    return (*thread = CreateThread(NULL, 0, thread_main, rec, 0, NULL)) != NULL;
+}
+
+static inline void join_thread(Thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
 #endif
 
-size_t msf_gif_save(const char * path, uint8_t ** frames, int frameCount, int width, int height,
-    int maxBitDepth, int centiSeconds, bool upsideDown, int maxThreads)
+#ifdef HAS_THREADS
+
+//NOTE: each frame goes through a pipeline of stages, and any worker can pick up any stage of any frame, except that
+//      a frame can only be compressed once the frame before it is cooked (since it's diffed against it), and frames
+//      are written strictly in order. raw buffers go back to the pool as soon as their frame is cooked, and cooked
+//      frames are freed once the frame after them has been compressed too
+
+enum { JOB_RAW, JOB_COOKING, JOB_COOKED, JOB_COMPRESSING, JOB_COMPRESSED, JOB_WRITTEN };
+
+typedef struct {
+    int stage;
+    uint8_t * raw; //first row to cook, which is the last one in memory for frames that are upside down
+    int pitchInBytes; //negative for frames that are upside down
+    bool pooled; //whether `raw` is one of the pool's buffers, rather than the caller's memory
+    int centiSeconds;
+    CookedFrame cooked;
+    FileBuffer buffer;
+} RecorderJob;
+
+struct MsfGifRecorder {
+    MsfGifState state;
+    int maxBitDepth;
+
+    Mutex mutex; //guards everything below, but not the frames themselves while a worker owns a stage
+    Cond workReady; //broadcast whenever a job changes stage, or the recorder is ending
+    Cond progress; //broadcast whenever a raw buffer or a queue slot frees up
+    bool ending, writing;
+
+    uint8_t * pool[RECORDER_POOL];
+    int poolFree; //pool[0, poolFree) are ready to be reused
+    int poolSize; //how many buffers have been allocated
+
+    RecorderJob * jobs; //frame i lives in jobs[i % window]
+    int window;
+    int tail, nextWrite, head; //frames [tail, head) are in flight, and [nextWrite, head) haven't been written yet
+
+    Thread threads[MAX_THREADS];
+    int threadCount;
+};
+
+static inline RecorderJob * job_at(MsfGifRecorder * rec, int frame) {
+    return &rec->jobs[frame % rec->window];
+}
+
+//frees the slots of written frames whose cooked pixels nothing will read again
+static void retire_jobs(MsfGifRecorder * rec) {
+    while (rec->tail < rec->nextWrite && rec->tail + 1 < rec->head
+        && job_at(rec, rec->tail + 1)->stage >= JOB_COMPRESSED)
+    {
+        free_cooked_frame(job_at(rec, rec->tail)->cooked);
+        ++rec->tail;
+        cond_broadcast(&rec->progress);
+    }
+}
+
+//does one stage of one frame, if there's any ready to be done, and returns whether it did
+//NOTE: called with the mutex locked, but unlocks it while doing the actual work
+static bool recorder_step(MsfGifRecorder * rec) {
+    //writing comes first, since nothing else frees up queue slots
+    RecorderJob * job = job_at(rec, rec->nextWrite);
+    if (!rec->writing && rec->nextWrite < rec->head && job->stage == JOB_COMPRESSED) {
+        rec->writing = true;
+        mutex_unlock(&rec->mutex);
+        fwrite(job->buffer.block, job->buffer.head - job->buffer.block, 1, rec->state.fp);
+        free(job->buffer.block);
+        mutex_lock(&rec->mutex);
+        job->stage = JOB_WRITTEN;
+        ++rec->nextWrite;
+        rec->writing = false;
+        retire_jobs(rec);
+        return true;
+    }
+
+    //otherwise the oldest frame that can move forward
+    for (int i = rec->tail; i < rec->head; ++i) {
+        job = job_at(rec, i);
+        if (job->stage == JOB_RAW) {
+            job->stage = JOB_COOKING;
+            mutex_unlock(&rec->mutex);
+            job->cooked = cook_frame(rec->state.width, rec->state.height, job->pitchInBytes, rec->maxBitDepth, job->raw);
+            mutex_lock(&rec->mutex);
+            job->stage = JOB_COOKED;
+            if (job->pooled) {
+                rec->pool[rec->poolFree++] = job->raw;
+                cond_broadcast(&rec->progress);
+            }
+            return true;
+        } else if (job->stage == JOB_COOKED && (i == 0 || job_at(rec, i - 1)->stage >= JOB_COOKED)) {
+            job->stage = JOB_COMPRESSING;
+            CookedFrame previous = i == 0? (CookedFrame) {} : job_at(rec, i - 1)->cooked;
+            mutex_unlock(&rec->mutex);
+            job->buffer = compress_frame(rec->state.width, rec->state.height, job->centiSeconds, job->cooked, previous);
+            mutex_lock(&rec->mutex);
+            job->stage = JOB_COMPRESSED;
+            retire_jobs(rec);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void recorder_thread(MsfGifRecorder * rec) {
+    mutex_lock(&rec->mutex);
+    while (true) {
+        if (recorder_step(rec)) {
+            cond_broadcast(&rec->workReady);
+        } else if (rec->ending && rec->nextWrite == rec->head) {
+            break;
+        } else {
+            cond_wait(&rec->workReady, &rec->mutex);
+        }
+    }
+    mutex_unlock(&rec->mutex);
+}
+
+static size_t finish_recorder(MsfGifRecorder * rec);
+
+static MsfGifRecorder * start_recorder(const char * path, int width, int height, int maxBitDepth, int maxThreads,
+    int window)
 {
+    MsfGifRecorder * rec = (MsfGifRecorder *) calloc(1, sizeof(MsfGifRecorder));
+    if (!msf_gif_begin(&rec->state, path, width, height)) {
+        if (rec->state.fp) fclose(rec->state.fp);
+        free(rec);
+        return NULL;
+    }
+    rec->maxBitDepth = maxBitDepth;
+    rec->window = max(2, window); //so one frame can be compressed while the next one is cooked
+    rec->jobs = (RecorderJob *) calloc(rec->window, sizeof(RecorderJob));
+    mutex_init(&rec->mutex);
+    cond_init(&rec->workReady);
+    cond_init(&rec->progress);
+
+    int threads = max(1, min(MAX_THREADS, min(maxThreads, core_count())));
+    for (int i = 0; i < threads; ++i) {
+        if (!start_thread(&rec->threads[rec->threadCount], rec)) break;
+        ++rec->threadCount;
+    }
+    if (!rec->threadCount) {
+        finish_recorder(rec);
+        return NULL;
+    }
+    return rec;
+}
+
+//if `copy` is false, the frame is encoded straight out of the caller's memory, which has to stay valid until the
+//recorder is finished. otherwise it's copied into a pooled buffer first, and the caller can reuse it right away
+static void queue_frame(MsfGifRecorder * rec, uint8_t * pixels, int pitchInBytes, int centiSeconds,
+    bool upsideDown, bool copy)
+{
+    int width = rec->state.width, height = rec->state.height;
+
+    //grab a free queue slot (and buffer), waiting on the workers only if there are none
+    mutex_lock(&rec->mutex);
+    while (rec->head - rec->tail == rec->window || (copy && !rec->poolFree && rec->poolSize == RECORDER_POOL)) {
+        cond_wait(&rec->progress, &rec->mutex);
+    }
+    uint8_t * raw = copy && rec->poolFree? rec->pool[--rec->poolFree] : NULL;
+    if (copy && !raw) ++rec->poolSize;
+    mutex_unlock(&rec->mutex);
+
+    //the slot at `head` belongs to this thread until `head` moves past it, so the copy can happen unlocked
+    if (!copy) {
+        raw = upsideDown? &pixels[pitchInBytes * (height - 1)] : pixels;
+        if (upsideDown) pitchInBytes *= -1;
+    } else {
+        if (!raw) raw = (uint8_t *) malloc(width * height * 4);
+        if (upsideDown) {
+            for (int y = 0; y < height; ++y) {
+                memcpy(&raw[y * width * 4], &pixels[(height - 1 - y) * pitchInBytes], width * 4);
+            }
+        } else if (pitchInBytes == width * 4) {
+            memcpy(raw, pixels, width * height * 4);
+        } else {
+            for (int y = 0; y < height; ++y) {
+                memcpy(&raw[y * width * 4], &pixels[y * pitchInBytes], width * 4);
+            }
+        }
+        pitchInBytes = width * 4;
+    }
+
+    mutex_lock(&rec->mutex);
+    *job_at(rec, rec->head) = (RecorderJob) { JOB_RAW, raw, pitchInBytes, copy, centiSeconds };
+    ++rec->head;
+    cond_broadcast(&rec->workReady);
+    mutex_unlock(&rec->mutex);
+}
+
+static size_t finish_recorder(MsfGifRecorder * rec) {
+    mutex_lock(&rec->mutex);
+    rec->ending = true;
+    cond_broadcast(&rec->workReady);
+    mutex_unlock(&rec->mutex);
+    for (int i = 0; i < rec->threadCount; ++i) {
+        join_thread(rec->threads[i]);
+    }
+
+    //every frame is written by now, but the last one's cooked pixels are still around
+    for (int i = rec->tail; i < rec->head; ++i) {
+        free_cooked_frame(job_at(rec, i)->cooked);
+    }
+    for (int i = 0; i < rec->poolFree; ++i) {
+        free(rec->pool[i]);
+    }
+    free(rec->jobs);
+    mutex_destroy(&rec->mutex);
+    cond_destroy(&rec->workReady);
+    cond_destroy(&rec->progress);
+
+    rec->state.previousFrame = (CookedFrame) {};
+    size_t bytesWritten = msf_gif_end(&rec->state);
+    free(rec);
+    return bytesWritten;
+}
+
+#else
+
+//no threads to hand frames off to on other platforms, so frames are encoded on the spot, same as the incremental API
+struct MsfGifRecorder {
     MsfGifState state;
-    msf_gif_begin(&state, path, width, height);
+    int maxBitDepth;
+};
 
-    CookedFrame * cookedFrames = (CookedFrame *) malloc(frameCount * sizeof(CookedFrame));
-    FileBuffer * buffers = (FileBuffer *) malloc(frameCount * sizeof(FileBuffer));
-    CookThreadData cookData = { frames, cookedFrames, buffers, frameCount,
-                                width, height, centiSeconds, maxBitDepth, upsideDown, 0 };
+static MsfGifRecorder * start_recorder(const char * path, int width, int height, int maxBitDepth, int maxThreads,
+    int window)
+{
+    MsfGifRecorder * rec = (MsfGifRecorder *) calloc(1, sizeof(MsfGifRecorder));
+    if (!msf_gif_begin(&rec->state, path, width, height)) {
+        if (rec->state.fp) fclose(rec->state.fp);
+        free(rec);
+        return NULL;
+    }
+    rec->maxBitDepth = maxBitDepth;
+    return rec;
+}
 
-    //NOTE: from empirical tests, it seems like both cooking and compressing benefit slightly from hyperthreading
-    fork_join(thread_cook_frames, &cookData, min(frameCount, maxThreads));
-    cookData.frameIdx = 0;
-    fork_join(thread_compress_frames, &cookData, min(frameCount, maxThreads));
+static void queue_frame(MsfGifRecorder * rec, uint8_t * pixels, int pitchInBytes, int centiSeconds,
+    bool upsideDown, bool copy)
+{
+    msf_gif_frame(&rec->state, pixels, pitchInBytes, centiSeconds, rec->maxBitDepth, upsideDown);
+}
+
+static size_t finish_recorder(MsfGifRecorder * rec) {
+    size_t bytesWritten = msf_gif_end(&rec->state);
+    free(rec);
+    return bytesWritten;
+}
 
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// Non-Incremental API                                                      ///
+////////////////////////////////////////////////////////////////////////////////
+
+size_t msf_gif_save(const char * path, uint8_t ** frames, int frameCount, int width, int height,
+    int maxBitDepth, int centiSeconds, bool upsideDown, int maxThreads, int window)
+{
+    //NOTE: from empirical tests, it seems like both cooking and compressing benefit slightly from hyperthreading
+    int threads = min(frameCount, maxThreads);
+    MsfGifRecorder * rec = start_recorder(path, width, height, maxBitDepth, threads, window > 0? window : threads * 2);
+    if (!rec) return 0;
     for (int i = 0; i < frameCount; ++i) {
-        fwrite(buffers[i].block, buffers[i].head - buffers[i].block, 1, state.fp);
-        free(cookedFrames[i].pixels);
-        free(cookedFrames[i].used);
-        free(buffers[i].block);
+        queue_frame(rec, frames[i], width * 4, centiSeconds, upsideDown, false);
     }
-    free(cookedFrames);
-    free(buffers);
+    return finish_recorder(rec);
+}
 
-    uint8_t trailingMarker = 0x3B;
-    fwrite(&trailingMarker, 1, 1, state.fp);
-    size_t bytesWritten = ftell(state.fp);
-    fclose(state.fp);
-    return bytesWritten;
+////////////////////////////////////////////////////////////////////////////////
+/// Asynchronous API                                                         ///
+////////////////////////////////////////////////////////////////////////////////
+
+#define RECORDER_WINDOW 16
+
+MsfGifRecorder * msf_gif_recorder_begin(const char * path, int width, int height, int maxBitDepth, int maxThreads) {
+    return start_recorder(path, width, height, maxBitDepth, maxThreads, RECORDER_WINDOW);
+}
+
+void msf_gif_recorder_frame(MsfGifRecorder * rec, uint8_t * pixels, int pitchInBytes, int centiSeconds,
+    bool upsideDown)
+{
+    queue_frame(rec, pixels, pitchInBytes, centiSeconds, upsideDown, true);
+}
+
+size_t msf_gif_recorder_end(MsfGifRecorder * rec) {
+    return finish_recorder(rec);
 }
@@ -10,6 +10,7 @@ typedef struct {
     uint32_t * pixels;
     bool * used;
     int rbits, gbits, bbits;
+    uint8_t * palette; //256 RGB triples for frames that came in already indexed (then `pixels` holds indices), or NULL
 } CookedFrame;
 
 typedef struct {
@@ -44,6 +45,18 @@ size_t msf_gif_begin(MsfGifState * state, const char * path, int width, int heig
  * @return              The size of the file written so far, or 0 on error.
  */
 size_t msf_gif_frame(MsfGifState * state, uint8_t * pixels, int pitchInBytes, int centiSeconds, int maxBitDepth, bool upsideDown);
+/**
+ * @brief               Like msf_gif_frame(), but for frames that are already palettized, which skips quantizing
+ *                      (and dithering) entirely. Frames that use all 256 palette entries don't leave room for
+ *                      the gif's transparent index, so those are expanded and go through msf_gif_frame() instead.
+ *
+ * @param indices       Pointer to one byte per pixel, each an index into `paletteRGBA`.
+ * @param pitchInBytes  Distance between the starts of consecutive rows of `indices`.
+ * @param paletteRGBA   Pointer to 256 RGBA8 colors. Alpha is ignored.
+ * @return              The size of the file written so far, or 0 on error.
+ */
+size_t msf_gif_frame_indexed(MsfGifState * state, uint8_t * indices, int pitchInBytes, const uint8_t * paletteRGBA,
+    int centiSeconds);
 /**
  * @return          The size of the written file in bytes, or 0 on error.
  */
@@ -54,15 +67,50 @@ size_t msf_gif_end(MsfGifState * handle);
 //all-at-once API
 
 /**
- * @brief               An alternative to the incremental API. Its only advantage is that it is multithreaded.
+ * @brief               An alternative to the incremental API. Its only advantage is that it is multithreaded
+ *                      (on the same platforms as the asynchronous API below).
  *                      All parameters shared with the incremental API are treated the same in both.
+ *                      Frames are encoded in a pipeline and written out in order as soon as they're done, so memory
+ *                      use is bounded by `window` rather than growing with the number of frames.
  *
  * @param maxThreads    This function will encode frames in parallel using the minimum of `maxThreads`, `frameCount`,
  *                      and the number of logical cores (a.k.a. hyperthreads) in the system.
+ * @param window        The most frames that can be in flight (cooked or compressed, but not yet written) at once.
+ *                      0 picks a default of twice the number of threads.
  * @return              The size of the written file in bytes, or 0 on error.
  */
 size_t msf_gif_save(const char * path, uint8_t ** frames, int frameCount, int width, int height,
-    int maxBitDepth, int centiSecondsPerFrame, bool upsideDown, int maxThreads);
+    int maxBitDepth, int centiSecondsPerFrame, bool upsideDown, int maxThreads, int window);
+
+
+
+//asynchronous API
+
+typedef struct MsfGifRecorder MsfGifRecorder;
+
+/**
+ * @brief               Like the incremental API, but frames are cooked, compressed and written on background threads,
+ *                      so the calling thread only pays for copying each frame into a pooled buffer.
+ *                      All parameters shared with the other APIs are treated the same.
+ *                      Threads are pthreads on unix-likes and Win32 threads on Windows (Vista or later). On any
+ *                      other platform there are no threads, and each frame is encoded synchronously when it's queued.
+ *
+ * @param maxThreads    Number of worker threads is the minimum of `maxThreads` and the number of logical cores,
+ *                      but there is always at least one, so that recording never stalls the caller.
+ * @return              The recorder, or NULL on error.
+ */
+MsfGifRecorder * msf_gif_recorder_begin(const char * path, int width, int height, int maxBitDepth, int maxThreads);
+/**
+ * @brief               Copies the frame and queues it, then returns without waiting for it to be encoded.
+ *                      Only blocks if the workers have fallen so far behind that every pooled buffer is in use.
+ */
+void msf_gif_recorder_frame(MsfGifRecorder * recorder, uint8_t * pixels, int pitchInBytes, int centiSeconds,
+    bool upsideDown);
+/**
+ * @brief               Waits for every queued frame to be written, then finishes the file and frees the recorder.
+ * @return              The size of the written file in bytes, or 0 on error.
+ */
+size_t msf_gif_recorder_end(MsfGifRecorder * recorder);
 #ifdef __cplusplus
 }
 #endif //__cplusplus
@@ -1,106 +1,504 @@
 #include "pixel.hpp"
 
+u32 lastImageSerial = 0;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// RUN SPRITES                                                                                                      ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+RunSprite make_run_sprite(Image & image, bool alphaTest) {
+    assert(image.width <= 0xFFFF);
+    auto kind = [alphaTest] (Pixel p) {
+        if (alphaTest) return p.a == 255? RUN_COPY : p.a > 127? RUN_CUTOUT : RUN_SKIP;
+        return p.a == 255? RUN_COPY : p.a == 0? RUN_SKIP : RUN_BLEND;
+    };
+
+    RunSprite sprite = { image, {}, {}, new_image_serial() };
+    for (int y = 0; y < image.height; ++y) {
+        sprite.rows.add(sprite.runs.len);
+        Pixel * row = image[y];
+        int x = 0;
+        while (x < image.width) {
+            int start = x;
+            RunKind k = kind(row[x]);
+            while (x < image.width && kind(row[x]) == k) ++x;
+            if (k != RUN_SKIP) sprite.runs.add({ (u16) start, (u16) (x - start), k });
+        }
+    }
+    sprite.rows.add(sprite.runs.len);
+    return sprite;
+}
+
+void draw_run_sprite(Canvas & canvas, RunSprite & sprite, int cx, int cy) {
+    Bounds b = intersect(canvas.clip, bounds(cx, cy, sprite.image.width, sprite.image.height));
+    if (empty(b)) return;
+    mark_dirty(canvas, b);
+
+    BlitFunc blend = blitBackend->blit[BLEND_OVER][SOURCE_COPY][0];
+    BlitFunc cutout = blitBackend->blit[BLEND_REPLACE][SOURCE_CUTOUT][0];
+    for (int y = b.miny; y < b.maxy; ++y) {
+        Pixel * src = sprite.image[y - cy] - cx; //indexed by canvas x, like `dst`
+        Pixel * dst = canvas[y];
+        int end = sprite.rows[y - cy + 1];
+        for (int i = sprite.rows[y - cy]; i < end; ++i) {
+            SpriteRun run = sprite.runs[i];
+            int minx = imax(b.minx, cx + run.x);
+            int maxx = imin(b.maxx, cx + run.x + run.width);
+            if (minx >= b.maxx) break;
+            if (minx >= maxx) continue;
+            if (run.kind == RUN_COPY) {
+                memcpy(dst + minx, src + minx, (maxx - minx) * sizeof(Pixel));
+            } else {
+                BlitFunc func = run.kind == RUN_CUTOUT? cutout : blend;
+                func({ dst + minx, src + minx, canvas.pitch, sprite.image.pitch, maxx - minx, 1 });
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// SHAPE OPS                                                                                                        ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//division rounding toward negative infinity, unlike C's `/` which rounds toward zero
+static inline int floordiv(int n, int d) {
+    int q = n / d;
+    return q - ((n % d != 0) && ((n < 0) != (d < 0)));
+}
+
+//calls `span(y, dy, minx, maxx)` for each row of the oval within the clip rect, with `maxx` exclusive
+//NOTE: the extents are solved for directly, then nudged with the exact per-pixel test so that they match it exactly
+template <typename FUNC>
+static void oval_spans(Canvas & canvas, int x0, int y0, int w, int h, FUNC span) {
+    //NOTE: pixels at x0 + w and y0 + h always fall outside the oval, so the max bounds can be exclusive
+    int minx = imax(canvas.clip.minx, x0 - w);
+    int miny = imax(canvas.clip.miny, y0 - h);
+    int maxx = imin(canvas.clip.maxx, x0 + w);
+    int maxy = imin(canvas.clip.maxy, y0 + h);
+    if (maxx <= minx || maxy <= miny) return;
+    mark_dirty(canvas, { minx, miny, maxx, maxy });
+    float xfactor = 1.0f / w;
+    float yfactor = 1.0f / h;
+    for (int y = miny; y < maxy; ++y) {
+        float dy = (y - y0 + 0.5f) * yfactor;
+        auto inside = [&] (int x) {
+            float dx = (x - x0 + 0.5f) * xfactor;
+            return dx * dx + dy * dy < 1;
+        };
+
+        float r = sqrtf(fmaxf(0, 1 - dy * dy)) * w;
+        int lo = imax(minx, imin(maxx, ceilf(x0 - 0.5f - r)));
+        int hi = imax(lo, imin(maxx, floorf(x0 - 0.5f + r) + 1));
+        while (lo > minx && inside(lo - 1)) --lo;
+        while (lo < hi && !inside(lo)) ++lo;
+        while (hi < maxx && inside(hi)) ++hi;
+        while (hi > lo && !inside(hi - 1)) --hi;
+
+        if (lo < hi) span(y, dy, lo, hi);
+    }
+}
+
+void draw_oval(Canvas & canvas, int x0, int y0, int w, int h, Color color) {
+    //nearly opaque colors are just drawn as opaque
+    BlendMode blend = color.a < 250? BLEND_OVER : BLEND_REPLACE;
+    if (blend == BLEND_REPLACE) color.a = 255;
+    oval_spans(canvas, x0, y0, w, h, [&] (int y, float dy, int minx, int maxx) {
+        _fill(canvas, { minx, y, maxx, y + 1 }, blend, color);
+    });
+}
+
+void draw_oval_add(Canvas & canvas, int x0, int y0, int w, int h, Color color) {
+    oval_spans(canvas, x0, y0, w, h, [&] (int y, float dy, int minx, int maxx) {
+        _fill(canvas, { minx, y, maxx, y + 1 }, BLEND_ADD, color);
+    });
+}
+
+void add_light(Canvas & canvas, int x0, int y0, int w, int h, Color color) {
+    float xfactor = 1.0f / w;
+    oval_spans(canvas, x0, y0, w, h, [&] (int y, float dy, int minx, int maxx) {
+        for (int x = minx; x < maxx; ++x) {
+            float dx = (x - x0 + 0.5f) * xfactor;
+            Color c = color;
+            float dist = (dx * dx + dy * dy);
+            float factor = fminf(255, (1 / dist - 1) * 64);
+            // c.a = (1 - sqrtf(dx * dx + dy * dy)) * 255;
+            c.a = (c.a * (u8)factor) >> 8;
+            unsafe_blend_add(canvas, x, y, c);
+        }
+    });
+}
+
+//a triangle edge function, as its value at (0, 0) plus how much it changes per step in x and y
+struct Edge {
+    int c, dx, dy;
+};
+
+//same as cross(coord2(x, y) - a, b - a)
+static inline Edge edge(int ax, int ay, int bx, int by) {
+    return { ay * (bx - ax) - ax * (by - ay), by - ay, -(bx - ax) };
+}
+
+static inline Edge negate(Edge e) {
+    return { -e.c, -e.dx, -e.dy };
+}
+
+//narrows [minx, maxx] down to the x for which the edge function on row y is non-negative
+static inline void clip_to_edge(Edge e, int y, int & minx, int & maxx) {
+    int c = e.c + e.dy * y;
+    if (e.dx > 0) {
+        minx = imax(minx, -floordiv(c, e.dx));
+    } else if (e.dx < 0) {
+        maxx = imin(maxx, floordiv(c, -e.dx));
+    } else if (c < 0) {
+        maxx = minx - 1;
+    }
+}
+
+//calls `span(y, minx, maxx, edges, area)` for each row of the triangle within the clip rect, with `maxx` inclusive
+//the three edge functions are oriented so that they're all non-negative inside the triangle, and sum to `area`
+//NOTE: degenerate triangles are skipped
+template <typename FUNC>
+static void triangle_spans(Canvas & canvas, int x1, int y1, int x2, int y2, int x3, int y3, FUNC span) {
+    Edge e[3] = { edge(x2, y2, x3, y3), edge(x3, y3, x1, y1), edge(x1, y1, x2, y2) };
+    int area = e[0].c + e[0].dx * x1 + e[0].dy * y1;
+    if (area == 0) return;
+    if (area < 0) {
+        for (Edge & edge : e) edge = negate(edge);
+    }
+
+    int minx = imax(canvas.clip.minx, imin(x1, imin(x2, x3)));
+    int miny = imax(canvas.clip.miny, imin(y1, imin(y2, y3)));
+    int maxx = imin(canvas.clip.maxx - 1, imax(x1, imax(x2, x3)));
+    int maxy = imin(canvas.clip.maxy - 1, imax(y1, imax(y2, y3)));
+    if (maxx < minx || maxy < miny) return;
+    mark_dirty(canvas, { minx, miny, maxx + 1, maxy + 1 });
+    for (int y = miny; y <= maxy; ++y) {
+        int lo = minx, hi = maxx;
+        for (Edge edge : e) clip_to_edge(edge, y, lo, hi);
+        if (lo <= hi) span(y, lo, hi, e, abs(area));
+    }
+}
+
+void draw_triangle(Canvas & canvas, int x1, int y1, int x2, int y2, int x3, int y3, Color c) {
+    triangle_spans(canvas, x1, y1, x2, y2, x3, y3, [&] (int y, int minx, int maxx, Edge * e, int area) {
+        _fill(canvas, { minx, y, maxx + 1, y + 1 }, BLEND_REPLACE, c);
+    });
+}
+
 //U and V are in pixel coordinates, not normalize [0,1] coordinates
 void draw_textured_triangle(Canvas & canvas, Image & tex,
     int x1, int y1, int u1, int v1,
     int x2, int y2, int u2, int v2,
     int x3, int y3, int u3, int v3)
 {
-    int area = cross(coord2(x1, y1) - coord2(x2, y2), coord2(x3, y3) - coord2(x2, y2));
-    if (area == 0) return;
+    //texture coords are (w1 * u1 + w2 * u2 + w3 * u3) / area, rounded toward zero, where w1..3 are the edge functions
+    //the numerators are linear in x, so each row steps a floored quotient and remainder instead of dividing per pixel
+    struct Stepper {
+        int q, r, dq, dr, d;
+        Stepper(int n, int dn, int d) : q(floordiv(n, d)), r(n - q * d), dq(floordiv(dn, d)), dr(dn - dq * d), d(d) {}
+        int value() { return q + (q < 0 && r != 0); }
+        void step() {
+            q += dq;
+            r += dr;
+            if (r >= d) { r -= d; ++q; }
+        }
+    };
 
-    int minx = imax(0, imin(x1, imin(x2, x3)));
-    int miny = imax(0, imin(y1, imin(y2, y3)));
-    int maxx = imin(canvas.width - 1, imax(x1, imax(x2, x3)));
-    int maxy = imin(canvas.height - 1, imax(y1, imax(y2, y3)));
-    for (int y = miny; y <= maxy; ++y) {
+    triangle_spans(canvas, x1, y1, x2, y2, x3, y3, [&] (int y, int minx, int maxx, Edge * e, int area) {
+        int w1 = e[0].c + e[0].dx * minx + e[0].dy * y;
+        int w2 = e[1].c + e[1].dx * minx + e[1].dy * y;
+        int w3 = e[2].c + e[2].dx * minx + e[2].dy * y;
+        Stepper u(w1 * u1 + w2 * u2 + w3 * u3, e[0].dx * u1 + e[1].dx * u2 + e[2].dx * u3, area);
+        Stepper v(w1 * v1 + w2 * v2 + w3 * v3, e[0].dx * v1 + e[1].dx * v2 + e[2].dx * v3, area);
         for (int x = minx; x <= maxx; ++x) {
-            int w1 = cross(coord2(x, y) - coord2(x2, y2), coord2(x3, y3) - coord2(x2, y2));
-            int w2 = cross(coord2(x, y) - coord2(x3, y3), coord2(x1, y1) - coord2(x3, y3));
-            int w3 = cross(coord2(x, y) - coord2(x1, y1), coord2(x2, y2) - coord2(x1, y1));
+            int tu = u.value(), tv = v.value();
+            //TODO: option to wrap texture using euclidean modulus?
+            if (tu >= 0 && tu < tex.width && tv >= 0 && tv < tex.height) {
+                unsafe_blend_premultiplied(canvas, x, y, tex[tv][tu]);
+            }
+            u.step();
+            v.step();
+        }
+    });
+}
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// TRANSFORMED SPRITES                                                                                              ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-            if ((w1 >= 0 && w2 >= 0 && w3 >= 0) || (w1 <= 0 && w2 <= 0 && w3 <= 0)) {
-                int u = w1 * u1 + w2 * u2 + w3 * u3;
-                int v = w1 * v1 + w2 * v2 + w3 * v3;
+static inline i64 floordiv(i64 n, i64 d) {
+    i64 q = n / d;
+    return q - ((n % d != 0) && ((n < 0) != (d < 0)));
+}
 
-                u /= area;
-                v /= area;
+//narrows [minx, maxx) down to the x for which `lo <= start + step * x < hi`
+static inline void clip_to_range(i64 start, i64 step, i64 lo, i64 hi, int & minx, int & maxx) {
+    i64 first, last;
+    if (step > 0) {
+        first = -floordiv(start - lo, step);
+        last = -floordiv(start - hi, step);
+    } else if (step < 0) {
+        first = floordiv(start - hi, -step) + 1;
+        last = floordiv(start - lo, -step) + 1;
+    } else {
+        first = start >= lo && start < hi? minx : maxx;
+        last = maxx;
+    }
+    if (first > minx) minx = first < maxx? first : maxx;
+    if (last < maxx) maxx = last > minx? last : minx;
+}
 
-                //TODO: option to wrap texture using euclidean modulus?
-                if (u >= 0 && u < tex.width && v >= 0 && v < tex.height) {
-                    unsafe_blend(canvas, x, y, tex[v][u]);
-                }
-            }
+void draw_transformed_sprite(Canvas & canvas, Image & sprite, Vec2 pos, float rotation, Vec2 scale,
+    SampleMode sample)
+{
+    //too small to see, and the per-pixel steps wouldn't fit in 16.16 fixed point anyway
+    if (fabsf(scale.x) * 1024 < 1 || fabsf(scale.y) * 1024 < 1) return;
+    assert(sprite.width < 0x8000 && sprite.height < 0x8000);
+
+    //the inverse of the transform, taking canvas coords back to texture coords
+    float c = cosf(rotation), s = sinf(rotation);
+    double dudx = c / scale.x, dudy = s / scale.x;
+    double dvdx = -s / scale.y, dvdy = c / scale.y;
+    auto fixed = [] (double f) { return (i64) floor(f * 65536 + 0.5); };
+    i64 du = fixed(dudx), dv = fixed(dvdx);
+
+    //rows the sprite might touch, padded by a pixel for bilinear's extra half texel of footprint
+    float hw = sprite.width * 0.5f, hh = sprite.height * 0.5f;
+    float ey = fabsf(s * (hw + 1) * scale.x) + fabsf(c * (hh + 1) * scale.y) + 1;
+    int miny = imax(canvas.clip.miny, floorf(pos.y - ey));
+    int maxy = imin(canvas.clip.maxy, ceilf(pos.y + ey));
+
+    //bilinear coords are of the top-left of the 2x2 texels, so they're shifted back by half a texel, and the
+    //edge kernel takes over wherever any of the four is missing, which only happens near the sprite's outline
+    i64 half = sample == SAMPLE_BILINEAR? 0x8000 : 0;
+    i64 texWidth = (i64) sprite.width << 16, texHeight = (i64) sprite.height << 16;
+
+    Bounds dirty = { canvas.clip.maxx, canvas.clip.maxy, canvas.clip.minx, canvas.clip.miny };
+    for (int y = miny; y < maxy; ++y) {
+        //texture coords at the center of pixel (0, y), so that x can step them exactly along the row
+        double py = y + 0.5 - pos.y, px = 0.5 - pos.x;
+        i64 u = fixed(dudx * px + dudy * py + hw) - half;
+        i64 v = fixed(dvdx * px + dvdy * py + hh) - half;
+
+        auto span = [&] (int x0, int x1, bool edge) {
+            if (x0 >= x1) return;
+            AffineSpan a = { canvas[y] + x0, sprite.pixels, sprite.pitch, sprite.width, sprite.height, x1 - x0,
+                             (int) (u + du * x0), (int) (v + dv * x0), (int) du, (int) dv };
+            blitBackend->affine[sample][edge](a);
+        };
+
+        int minx = canvas.clip.minx, maxx = canvas.clip.maxx;
+        if (sample == SAMPLE_NEAREST) {
+            clip_to_range(u, du, 0, texWidth, minx, maxx);
+            clip_to_range(v, dv, 0, texHeight, minx, maxx);
+            span(minx, maxx, false);
+        } else {
+            clip_to_range(u, du, -0xFFFF, texWidth, minx, maxx);
+            clip_to_range(v, dv, -0xFFFF, texHeight, minx, maxx);
+            int lo = minx, hi = maxx;
+            clip_to_range(u, du, 0, texWidth - 0x10000, lo, hi);
+            clip_to_range(v, dv, 0, texHeight - 0x10000, lo, hi);
+            if (lo >= hi) lo = hi = maxx;
+            span(minx, lo, true);
+            span(lo, hi, false);
+            span(hi, maxx, true);
+        }
+
+        if (minx < maxx) {
+            dirty = merge(dirty, { minx, y, maxx, y + 1 });
         }
     }
+    if (!empty(dirty)) mark_dirty(canvas, dirty);
 }
 
-void add_light(Canvas & canvas, int x0, int y0, int w, int h, Color color) {
-    int minx = imax(0, x0 - w);
-    int miny = imax(0, y0 - h);
-    int maxx = imin(canvas.width, x0 + w);
-    int maxy = imin(canvas.height, y0 + h);
-    if (maxx < minx || maxy < miny) return;
-    float xfactor = 1.0f / w;
-    float yfactor = 1.0f / h;
-    for (int y = miny; y <= maxy; ++y) {
-        for (int x = minx; x <= maxx; ++x) {
-            float dx = (x - x0 + 0.5f) * xfactor;
-            float dy = (y - y0 + 0.5f) * yfactor;
-            if (dx * dx + dy * dy < 1) {
-                Color c = color;
-                float dist = (dx * dx + dy * dy);
-                float factor = fminf(255, (1 / dist - 1) * 64);
-                // c.a = (1 - sqrtf(dx * dx + dy * dy)) * 255;
-                c.a = (c.a * (u8)factor) >> 8;
-                unsafe_blend_add(canvas, x, y, c);
+void add_dirty_rect(DirtyList & list, Bounds b) {
+    for (int i = 0; i < list.count; ++i) {
+        if (contains(list.rects[i], b)) return;
+    }
+
+    //absorb every rect the new one overlaps, repeating since growing it can make it overlap more
+    //once there are no overlaps left, if the list is full, merge with the rect that adds the least area and repeat
+    int i = 0;
+    while (i < list.count || list.count == MAX_DIRTY_RECTS) {
+        if (i == list.count) {
+            int best = 0;
+            for (int j = 1; j < list.count; ++j) {
+                int growth = area(merge(list.rects[j], b)) - area(list.rects[j]);
+                if (growth < area(merge(list.rects[best], b)) - area(list.rects[best])) best = j;
             }
+            i = best;
+        } else if (!overlaps(list.rects[i], b)) {
+            ++i;
+            continue;
         }
+        b = merge(b, list.rects[i]);
+        list.rects[i] = list.rects[--list.count];
+        i = 0;
     }
+    list.rects[list.count++] = b;
 }
 
-void _draw_sprite_a1(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy) {
-    //destination coords
-    int minx = imax(0, cx);
-    int miny = imax(0, cy);
-    int maxx = imin(canvas.width, cx + width);
-    int maxy = imin(canvas.height, cy + height);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// CANVAS PRESENTER                                                                                                 ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    //source coords
-    int srcx = minx - cx;
-    int srcy = miny - cy;
-    int srcw = maxx - minx;
-    int srch = maxy - miny;
+static void update_canvas_verts(CanvasPresenter & presenter, Canvas & canvas, float ww, float wh) {
+    presenter.ww = ww;
+    presenter.wh = wh;
+    float w = presenter.texWidth, h = presenter.texHeight;
 
-    #ifdef SSE_BLIT
-        const __m128i iSrcw = _mm_set1_epi32(srcw);
-        const __m128i i3210 = _mm_set_epi32(3, 2, 1, 0);
-        const __m128i zero = (__m128i) _mm_set1_epi32(0);
+    //NOTE: this still doesn't actually work to get rid of scaling artifacts
+    //      except at 2x scale where it kinda sorta accidentally mostly works by happenstance
+    float u1 = canvas.margin / w - 0.5f / ww;
+    float v1 = canvas.margin / h - 0.5f / wh;
+    float u2 = 1 - u1 - 1.0f / ww;
+    float v2 = 1 - v1 - 1.0f / wh;
 
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; x += 4) {
-                __m128i ix = _mm_add_epi32(i3210, _mm_set1_epi32(x));
-                __m128i inclusionMask = _mm_cmplt_epi32(ix, iSrcw);
+    float x = fminf(1, (wh / ww) / (canvas.height / (float) canvas.width));
+    float y = fminf(1, (ww / wh) / (canvas.width / (float) canvas.height));
 
-                Pixel * canvSrc = &canvas[miny + y][minx + x];
-                __m128i src = _mm_loadu_si128((__m128i *) canvSrc);
-                Pixel * imgSrc = &pixels[(srcy + y) * pitch + srcx + x];
-                __m128i img = _mm_loadu_si128((__m128i *) imgSrc);
+    struct TexVert { Vec2 pos, uv; };
+    TexVert verts[6] = {
+        { vec2(-x,  y), vec2(u1, v1) },
+        { vec2( x,  y), vec2(u2, v1) },
+        { vec2( x, -y), vec2(u2, v2) },
+        { vec2(-x,  y), vec2(u1, v1) },
+        { vec2( x, -y), vec2(u2, v2) },
+        { vec2(-x, -y), vec2(u1, v2) },
+    };
 
-                __m128i alphaMask = _mm_and_si128(_mm_cmplt_epi32(img, zero), inclusionMask);
-                __m128i c = _mm_blendv_epi8(src, img, alphaMask); //@SSE4.1
-                _mm_storeu_si128((__m128i *) canvSrc, c);
-            }
+    glBindVertexArray(presenter.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, presenter.vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
+
+    //setup vertex attributes
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TexVert), (void *) offsetof(TexVert, pos));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TexVert), (void *) offsetof(TexVert, uv));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+}
+
+//TODO: improve pixel blending by using an SRGB texture
+CanvasPresenter make_canvas_presenter(uint shader, Canvas & canvas) {
+    CanvasPresenter presenter = {};
+    presenter.shader = shader;
+    presenter.texWidth = canvas.width + canvas.margin * 2;
+    presenter.texHeight = canvas.height + canvas.margin * 2;
+
+    glGenTextures(1, &presenter.tex);
+    glBindTexture(GL_TEXTURE_2D, presenter.tex);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, presenter.texWidth, presenter.texHeight, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, canvas.basePointer());
+
+    //storage is allocated up front, but the contents are respecified every time a buffer is mapped
+    int bytes = presenter.texWidth * presenter.texHeight * sizeof(Pixel);
+    glGenBuffers(CANVAS_UPLOAD_BUFFERS, presenter.pbo);
+    for (int i = 0; i < CANVAS_UPLOAD_BUFFERS; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, presenter.pbo[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glGenVertexArrays(1, &presenter.vao);
+    glGenBuffers(1, &presenter.vbo);
+
+    presenter.texSizeLoc = glGetUniformLocation(shader, "texSize");
+    presenter.scaleLoc = glGetUniformLocation(shader, "scale");
+
+    gl_error("make_canvas_presenter()");
+    return presenter;
+}
+
+void free_canvas_presenter(CanvasPresenter & presenter) {
+    glDeleteTextures(1, &presenter.tex);
+    glDeleteBuffers(CANVAS_UPLOAD_BUFFERS, presenter.pbo);
+    glDeleteBuffers(1, &presenter.vbo);
+    glDeleteVertexArrays(1, &presenter.vao);
+    presenter = {};
+}
+
+//uploads the rows covered by the canvas's dirty list, as a few contiguous full-width bands
+static void upload_dirty_rows(CanvasPresenter & presenter, Canvas & canvas) {
+    if (!canvas.dirty || canvas.dirty->count == 0) return;
+
+    //collect the row ranges of all dirty rects (in texture rows) and sort them by their first row
+    struct Band { int miny, maxy; };
+    Band bands[MAX_DIRTY_RECTS];
+    int count = 0;
+    for (int i = 0; i < canvas.dirty->count; ++i) {
+        Band band = { canvas.dirty->rects[i].miny + canvas.margin, canvas.dirty->rects[i].maxy + canvas.margin };
+        int j = count++;
+        for (; j > 0 && bands[j - 1].miny > band.miny; --j) bands[j] = bands[j - 1];
+        bands[j] = band;
+    }
+
+    //merge overlapping and touching ranges
+    int merged = 0;
+    for (int i = 1; i < count; ++i) {
+        if (bands[i].miny <= bands[merged].maxy) {
+            bands[merged].maxy = imax(bands[merged].maxy, bands[i].maxy);
+        } else {
+            bands[++merged] = bands[i];
         }
-    #else
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; ++x) {
-                Color c = pixels[(srcy + y) * pitch + srcx + x];
-                if (c.a > 127) {
-                    canvas[miny + y][minx + x] = c;
-                }
-            }
+    }
+    count = merged + 1;
+
+    int rowBytes = presenter.texWidth * sizeof(Pixel);
+    int firstByte = bands[0].miny * rowBytes;
+    int lastByte = bands[count - 1].maxy * rowBytes;
+    Pixel * base = canvas.basePointer();
+
+    glBindTexture(GL_TEXTURE_2D, presenter.tex);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, presenter.pbo[presenter.nextPbo]);
+    presenter.nextPbo = (presenter.nextPbo + 1) % CANVAS_UPLOAD_BUFFERS;
+
+    u8 * mapped = (u8 *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, firstByte, lastByte - firstByte,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (mapped) {
+        for (int i = 0; i < count; ++i) {
+            memcpy(mapped + bands[i].miny * rowBytes - firstByte, base + bands[i].miny * presenter.texWidth,
+                (bands[i].maxy - bands[i].miny) * rowBytes);
         }
-    #endif
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    } else {
+        //fall back to uploading straight from the canvas if the buffer can't be mapped for some reason
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    for (int i = 0; i < count; ++i) {
+        const void * data = mapped? (void *) (uintptr_t) (bands[i].miny * rowBytes)
+                                  : (void *) (base + bands[i].miny * presenter.texWidth);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, bands[i].miny, presenter.texWidth, bands[i].maxy - bands[i].miny,
+            GL_RGBA, GL_UNSIGNED_BYTE, data);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void draw_canvas(CanvasPresenter & presenter, Canvas & canvas, float ww, float wh) {
+    upload_dirty_rows(presenter, canvas);
+
+    if (ww != presenter.ww || wh != presenter.wh) {
+        update_canvas_verts(presenter, canvas, ww, wh);
+    }
+
+    //bind texture
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, presenter.tex);
+
+    //set uniforms and draw
+    glBindVertexArray(presenter.vao);
+    glUseProgram(presenter.shader);
+    glUniform2f(presenter.texSizeLoc, presenter.texWidth, presenter.texHeight);
+    float scale = fminf(ww / canvas.width, wh / canvas.height);
+    glUniform1f(presenter.scaleLoc, scale);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    gl_error("draw_canvas()");
 }
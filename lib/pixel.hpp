@@ -7,12 +7,58 @@
 #include <immintrin.h>
 #include <smmintrin.h>
 
+//half-open pixel bounds, i.e. [minx, maxx) by [miny, maxy)
+struct Bounds {
+    int minx, miny, maxx, maxy;
+};
+
+static inline Bounds bounds(int x, int y, int w, int h) {
+    return { x, y, x + w, y + h };
+}
+
+static inline bool empty(Bounds b) {
+    return b.minx >= b.maxx || b.miny >= b.maxy;
+}
+
+static inline int area(Bounds b) {
+    return empty(b)? 0 : (b.maxx - b.minx) * (b.maxy - b.miny);
+}
+
+static inline Bounds intersect(Bounds a, Bounds b) {
+    return { imax(a.minx, b.minx), imax(a.miny, b.miny), imin(a.maxx, b.maxx), imin(a.maxy, b.maxy) };
+}
+
+//smallest bounds containing both
+static inline Bounds merge(Bounds a, Bounds b) {
+    return { imin(a.minx, b.minx), imin(a.miny, b.miny), imax(a.maxx, b.maxx), imax(a.maxy, b.maxy) };
+}
+
+static inline bool contains(Bounds outer, Bounds inner) {
+    return inner.minx >= outer.minx && inner.miny >= outer.miny && inner.maxx <= outer.maxx && inner.maxy <= outer.maxy;
+}
+
+static inline bool overlaps(Bounds a, Bounds b) {
+    return !empty(intersect(a, b));
+}
+
+//NOTE: rects in the list never overlap each other, and when the list is full,
+//      new rects get merged into whichever existing rect grows the least
+#define MAX_DIRTY_RECTS 16
+struct DirtyList {
+    Bounds rects[MAX_DIRTY_RECTS];
+    int count;
+};
+
+void add_dirty_rect(DirtyList & list, Bounds b);
+
 struct Canvas {
     Pixel * pixels;
     int width;
     int height;
     int pitch; //number of pixels, NOT number of bytes!
     int margin; //number of pixels, NOT number of bytes!
+    Bounds clip; //all draw ops are clipped to this, which must lie within [0, width) by [0, height)
+    DirtyList * dirty; //regions touched since the last clear_dirty(), or null to not track them
 
     //NOTE: indexed in [y][x] order!!!
     __attribute__((__always_inline__)) Pixel * operator[] (int row) {
@@ -24,288 +70,370 @@ struct Canvas {
     }
 };
 
+//draw ops call this with the (clipped) region they touched, and the app can call it to force a region to be redrawn
+static inline void mark_dirty(Canvas & canvas, Bounds b) {
+    b = intersect(b, bounds(0, 0, canvas.width, canvas.height));
+    if (canvas.dirty && !empty(b)) add_dirty_rect(*canvas.dirty, b);
+}
+
+static inline void clear_dirty(Canvas & canvas) {
+    if (canvas.dirty) canvas.dirty->count = 0;
+}
+
+static inline void set_clip(Canvas & canvas, Bounds clip) {
+    canvas.clip = intersect(clip, bounds(0, 0, canvas.width, canvas.height));
+}
+
+static inline void reset_clip(Canvas & canvas) {
+    canvas.clip = bounds(0, 0, canvas.width, canvas.height);
+}
+
+//x / 255 rounded to nearest, exact for all x in [0, 255 * 255]
+static inline int div255(int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+//NOTE: Color values passed to draw ops are straight alpha, but Image pixels are premultiplied (see load_image())
+static inline Pixel premultiply(Color c) {
+    return { (u8) div255(c.r * c.a), (u8) div255(c.g * c.a), (u8) div255(c.b * c.a), c.a };
+}
+
+//the inverse of premultiply(), rounded to nearest, for pixels with nonzero alpha
+static inline Color unpremultiply(Pixel p) {
+    if (p.a == 255) return p;
+    auto straight = [p] (u8 c) { return (u8) imin(255, (c * 255 + p.a / 2) / p.a); };
+    return { straight(p.r), straight(p.g), straight(p.b), p.a };
+}
+
+//decodes a pixel's color channels to linear light, one channel per lane, with alpha scaled to [0, 1]
+static inline __m128 srgb_to_linear_ps(Pixel p) {
+    return _mm_setr_ps(srgb_to_linear(p.r), srgb_to_linear(p.g), srgb_to_linear(p.b), p.a * (1.0f / 255));
+}
+
+//encodes linear light back to sRGB, the inverse of srgb_to_linear_ps()
+static inline Pixel linear_to_srgb_ps(__m128 v) {
+    __m128 steps = _mm_setr_ps(SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, SRGB_ENCODE_STEPS - 1, 255);
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1));
+    alignas(16) int i[4];
+    _mm_store_si128((__m128i *) i, _mm_cvtps_epi32(_mm_mul_ps(v, steps)));
+    return { srgbTables.toSrgb[i[0]], srgbTables.toSrgb[i[1]], srgbTables.toSrgb[i[2]], (u8) i[3] };
+}
+
+//alpha blends a premultiplied source over the destination in linear light, keeping destination alpha
+//NOTE: sources are premultiplied in sRGB space, so they have to be unpremultiplied before they can be decoded
+static inline Pixel blend_over_linear(Pixel s, Pixel d) {
+    if (s.a == 0) return d;
+    if (s.a == 255) return { s.r, s.g, s.b, d.a };
+    int recip = (255 << 16) / s.a;
+    auto straight = [recip] (u8 c) { return (u8) imin(255, (c * recip + (1 << 15)) >> 16); };
+    __m128 src = srgb_to_linear_ps({ straight(s.r), straight(s.g), straight(s.b), s.a });
+    __m128 dst = srgb_to_linear_ps(d);
+    __m128 alpha = _mm_shuffle_ps(src, src, _MM_SHUFFLE(3, 3, 3, 3));
+    Pixel out = linear_to_srgb_ps(_mm_add_ps(_mm_mul_ps(src, alpha), _mm_mul_ps(dst, _mm_sub_ps(_mm_set1_ps(1), alpha))));
+    out.a = d.a;
+    return out;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BLIT BACKENDS                                                                                                    ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//how the (possibly modified) source color is combined with the destination
+//NOTE: all modes except BLEND_REPLACE leave destination alpha untouched
+//NOTE: sources are premultiplied, and all blending divides by 255 exactly, so stacking many translucent
+//      sprites doesn't slowly darken the destination the way the old `>> 8` approximation did
+enum BlendMode {
+    BLEND_OVER,     //regular alpha blending
+    BLEND_REPLACE,  //overwrite the destination, including alpha
+    BLEND_ADD,      //add source color scaled by source alpha, saturating
+    BLEND_MULTIPLY, //multiply by source color, faded in by source alpha
+    BLEND_SCREEN,   //inverse multiply by source color, faded in by source alpha
+    BLEND_OVER_LINEAR, //alpha blending in linear light, which is correct but costs table lookups per channel
+    BLEND_MODE_COUNT
+};
+
+//what color each source pixel contributes before blending
+enum SourceMode {
+    SOURCE_COPY,    //the source pixel as-is
+    SOURCE_ALPHA,   //the source pixel faded by Blit::alpha
+    SOURCE_TINT,    //the source pixel multiplied channel-wise (including alpha) by Blit::color
+    SOURCE_FILL,    //Blit::color, but only where source alpha is above 127 (silhouettes)
+    SOURCE_CUTOUT,  //the source pixel unpremultiplied and made opaque, but only where source alpha is above 127
+                    //(1-bit alpha)
+    SOURCE_MODE_COUNT
+};
+
+//a blit region that has already been clipped against the canvas clip rect
+//NOTE: for flipped blits, `src` points at the source pixel that lands on `dst`, and the source is walked leftward
+struct Blit {
+    Pixel * dst;
+    Pixel * src;
+    int dstPitch; //number of pixels, NOT number of bytes!
+    int srcPitch; //number of pixels, NOT number of bytes!
+    int w, h;
+    float alpha; //used by SOURCE_ALPHA
+    Color color; //used by SOURCE_TINT and SOURCE_FILL, straight alpha (the kernels premultiply it)
+};
+
+typedef void (* BlitFunc) (const Blit & blit);
+
+//how scaled and rotated sprites are sampled
+enum SampleMode {
+    SAMPLE_NEAREST,  //the texel under the center of each destination pixel
+    SAMPLE_BILINEAR, //the 2x2 texels around it, weighted, with transparency past the edges of the sprite
+    SAMPLE_MODE_COUNT
+};
+
+//one row of a scaled or rotated sprite, always blended with BLEND_OVER
+//texture coords are 16.16 fixed point, and step by (du, dv) from (u, v) at the first destination pixel
+//NOTE: for SAMPLE_NEAREST, (u, v) is the texel itself. for SAMPLE_BILINEAR, it's the top-left of the 2x2 texels,
+//      and all four have to be inside the texture, unless the span goes through the edge version of the kernel,
+//      which bounds-checks every tap and treats anything outside the texture as transparent
+struct AffineSpan {
+    Pixel * dst;
+    Pixel * tex;
+    int texPitch; //number of pixels, NOT number of bytes!
+    int texWidth, texHeight; //only used by the edge kernels
+    int w;
+    int u, v, du, dv;
+};
+
+typedef void (* AffineFunc) (const AffineSpan & span);
+
+//a region of an indexed canvas being turned into full color, by looking each byte up in a 256-entry palette
+struct Expand {
+    Pixel * dst;
+    const u8 * src;
+    int dstPitch; //number of pixels, NOT number of bytes!
+    int srcPitch;
+    int w, h;
+    const Pixel * palette;
+};
+
+typedef void (* ExpandFunc) (const Expand & expand);
+
+//every backend produces bit-identical results to the scalar one, they only differ in speed
+struct BlitBackend {
+    const char * name;
+    BlitFunc blit[BLEND_MODE_COUNT][SOURCE_MODE_COUNT][2]; //indexed [blend][source][flip]
+    BlitFunc fill[BLEND_MODE_COUNT]; //blends Blit::color over the destination, ignoring `src`
+    AffineFunc affine[SAMPLE_MODE_COUNT][2]; //indexed [sample][edge]
+    ExpandFunc expand;
+};
+
+enum BlitBackendType { BLIT_SCALAR, BLIT_SSE2, BLIT_SSE41, BLIT_AVX2, BLIT_BACKEND_COUNT };
+
+extern const BlitBackend blitBackends[BLIT_BACKEND_COUNT];
+extern const BlitBackend * blitBackend; //the one all sprite ops dispatch through
+
+bool blit_backend_supported(BlitBackendType type);
+//selects the fastest backend supported by this CPU that is no faster than `type`, and returns it
+const BlitBackend * select_blit_backend(BlitBackendType type = BLIT_AVX2);
+
+static inline bool clip_blit(Canvas & canvas, Pixel * pixels, int width, int height, int pitch,
+    int cx, int cy, bool flip, Blit & blit)
+{
+    //destination coords
+    int minx = imax(canvas.clip.minx, cx);
+    int miny = imax(canvas.clip.miny, cy);
+    int maxx = imin(canvas.clip.maxx, cx + width);
+    int maxy = imin(canvas.clip.maxy, cy + height);
+
+    if (minx >= maxx || miny >= maxy) return false;
+    mark_dirty(canvas, { minx, miny, maxx, maxy });
+
+    //source coords
+    int srcx = minx - cx;
+    int srcy = miny - cy;
+    if (flip) srcx = width - 1 - srcx;
+
+    blit = { &canvas[miny][minx], &pixels[srcy * pitch + srcx], canvas.pitch, pitch, maxx - minx, maxy - miny };
+    return true;
+}
+
+static inline void _blit(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy,
+    BlendMode blend, SourceMode source, bool flip = false, float alpha = 1, Color color = {})
+{
+    Blit blit;
+    if (clip_blit(canvas, pixels, width, height, pitch, cx, cy, flip, blit)) {
+        blit.alpha = alpha;
+        blit.color = color;
+        blitBackend->blit[blend][source][flip](blit);
+    }
+}
+
+//blends a solid color over a region, which must already be clipped (and marked dirty) by the caller
+static inline void _fill(Canvas & canvas, Bounds b, BlendMode blend, Color color) {
+    if (empty(b)) return;
+    Blit blit = { &canvas[b.miny][b.minx], nullptr, canvas.pitch, 0, b.maxx - b.minx, b.maxy - b.miny, 1, color };
+    blitBackend->fill[blend](blit);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// SPRITE OPS                                                                                                       ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+//NOTE: images can be views into a bigger buffer (see atlas.hpp), so rows are `pitch` apart rather than `width`
 struct Image {
     Pixel * pixels;
     int width;
     int height;
+    int pitch; //number of pixels, NOT number of bytes!
+    u32 serial; //from new_image_serial() when the pixels were made, or 0 for images put together by hand
 
     //NOTE: indexed in [y][x] order!!!
     __attribute__((__always_inline__)) Pixel * operator[] (int row) {
-        return pixels + row * width;
+        return pixels + row * pitch;
     }
 };
 
+//tells apart images that might end up with the same pixel pointer, when one's pixels get freed and reused for another
+extern u32 lastImageSerial;
+
+static inline u32 new_image_serial() {
+    return ++lastImageSerial;
+}
+
+//NOTE: image pixels are stored with premultiplied alpha, which is what all the sprite ops expect
 static inline Image load_image(const char * filepath) {
     int w, h, c;
     Pixel * pixels = (Pixel *) stbi_load(filepath, &w, &h, &c, 4);
     assert(pixels);
+    for (int i = 0; i < w * h; ++i) {
+        pixels[i] = premultiply(pixels[i]);
+    }
     //add 4 pixel padding for SIMD loads off the end
     pixels = (Pixel *) realloc(pixels, w * h * sizeof(Pixel) + 4 * sizeof(Pixel));
-    return { pixels, w, h };
+    return { pixels, w, h, w, new_image_serial() };
 }
 
 static __attribute__((__always_inline__))
 void unsafe_blend(Canvas & canvas, int x, int y, Color color) {
     Pixel * row = canvas.pixels + y * canvas.pitch;
-    row[x].r = (color.r * color.a + row[x].r * (255 - color.a)) >> 8;
-    row[x].g = (color.g * color.a + row[x].g * (255 - color.a)) >> 8;
-    row[x].b = (color.b * color.a + row[x].b * (255 - color.a)) >> 8;
+    row[x].r = div255(color.r * color.a + row[x].r * (255 - color.a));
+    row[x].g = div255(color.g * color.a + row[x].g * (255 - color.a));
+    row[x].b = div255(color.b * color.a + row[x].b * (255 - color.a));
 }
 
 static __attribute__((__always_inline__))
 void blend(Canvas canvas, int x, int y, Color color) {
-    if (x >= 0 && x < canvas.width && y >= 0 && y < canvas.height) {
-        Pixel * row = canvas.pixels + y * canvas.pitch;
-        row[x].r = (color.r * color.a + row[x].r * (255 - color.a)) >> 8;
-        row[x].g = (color.g * color.a + row[x].g * (255 - color.a)) >> 8;
-        row[x].b = (color.b * color.a + row[x].b * (255 - color.a)) >> 8;
+    if (x >= canvas.clip.minx && x < canvas.clip.maxx && y >= canvas.clip.miny && y < canvas.clip.maxy) {
+        unsafe_blend(canvas, x, y, color);
     }
 }
 
+//like unsafe_blend(), but for a premultiplied image pixel
+static __attribute__((__always_inline__))
+void unsafe_blend_premultiplied(Canvas & canvas, int x, int y, Pixel p) {
+    Pixel * row = canvas.pixels + y * canvas.pitch;
+    row[x].r = imin(255, p.r + div255(row[x].r * (255 - p.a)));
+    row[x].g = imin(255, p.g + div255(row[x].g * (255 - p.a)));
+    row[x].b = imin(255, p.b + div255(row[x].b * (255 - p.a)));
+}
+
 static __attribute__((__always_inline__))
 void unsafe_blend_add(Canvas & canvas, int x, int y, Color color) {
     Pixel * row = canvas.pixels + y * canvas.pitch;
-    row[x].r = imin(255, row[x].r + ((color.r * color.a) >> 8));
-    row[x].g = imin(255, row[x].g + ((color.g * color.a) >> 8));
-    row[x].b = imin(255, row[x].b + ((color.b * color.a) >> 8));
+    row[x].r = imin(255, row[x].r + div255(color.r * color.a));
+    row[x].g = imin(255, row[x].g + div255(color.g * color.a));
+    row[x].b = imin(255, row[x].b + div255(color.b * color.a));
 }
 
 static __attribute__((__always_inline__))
 void blend_add(Canvas canvas, int x, int y, Color color) {
-    if (x >= 0 && x < canvas.width && y >= 0 && y < canvas.height) {
-        Pixel * row = canvas.pixels + y * canvas.pitch;
-        row[x].r = imin(255, row[x].r + ((color.r * color.a) >> 8));
-        row[x].g = imin(255, row[x].g + ((color.g * color.a) >> 8));
-        row[x].b = imin(255, row[x].b + ((color.b * color.a) >> 8));
+    if (x >= canvas.clip.minx && x < canvas.clip.maxx && y >= canvas.clip.miny && y < canvas.clip.maxy) {
+        unsafe_blend_add(canvas, x, y, color);
     }
 }
 
-// #define SSE_BLIT
-
-//TODO: refactor these to only differ in the blend function
-
-void _draw_sprite_a1(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy);
+static inline void _draw_sprite_a1(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy) {
+    _blit(canvas, pixels, width, height, pitch, cx, cy, BLEND_REPLACE, SOURCE_CUTOUT);
+}
 
 static inline void draw_sprite_a1(Canvas & canvas, Image & image, int cx, int cy) {
-    _draw_sprite_a1(canvas, image.pixels, image.width, image.height, image.width, cx, cy);
+    _draw_sprite_a1(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy);
 }
 
 static inline void _draw_sprite(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy) {
-    //destination coords
-    int minx = imax(0, cx);
-    int miny = imax(0, cy);
-    int maxx = imin(canvas.width, cx + width);
-    int maxy = imin(canvas.height, cy + height);
-
-    if (minx >= maxx || miny >= maxy) return;
-
-    //source coords
-    int srcx = minx - cx;
-    int srcy = miny - cy;
-    int srcw = maxx - minx;
-    int srch = maxy - miny;
-
-    #ifdef SSE_BLIT
-        const __m128i i3210 = _mm_set_epi32(3, 2, 1, 0);
-        const __m128i rbMask1 = _mm_set1_epi32(0x00FF00FF);
-        const __m128i gMask1 = _mm_set1_epi32(0x0000FF00);
-        const __m128i iSrcw = _mm_set1_epi32(srcw);
-        const __m128i rbMask2 = _mm_set1_epi32(0xFF00FF00);
-
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; x += 4) {
-                //we use this to set the alpha of pixels outside the region to 0 so they will be ignored
-                __m128i inclusionMask = _mm_cmplt_epi32(_mm_add_epi32(i3210, _mm_set1_epi32(x)), iSrcw);
-
-                __m128i dst = _mm_loadu_si128((__m128i *) &canvas[miny + y][minx + x]);
-                __m128i src = _mm_loadu_si128((__m128i *) &pixels[(srcy + y) * pitch + srcx + x]);
-
-                //unpack alpha and 1-alpha into 16-bit lanes
-                //TODO: can we use shuffles for this?
-                __m128i a = _mm_and_si128(_mm_srli_epi32(src, 24), inclusionMask);
-                __m128i a1 = _mm_or_si128(a, _mm_slli_epi32(a, 16));
-                __m128i a2 = _mm_sub_epi16(_mm_set1_epi16(255), a1);
-
-                //unpack color channels into 16-bit lanes and multiple with alpha and 1-alpha
-                __m128i rb1 = _mm_mullo_epi16(_mm_and_si128(src, rbMask1), a1); //0x00FF00FF -> 0xFFFFFFFF
-                __m128i rb2 = _mm_mullo_epi16(_mm_and_si128(dst, rbMask1), a2); //0x00FF00FF -> 0xFFFFFFFF
-                __m128i g1 = _mm_mulhi_epu16(_mm_and_si128(src, gMask1), a1); //0x0000FF00 -> 0x000000FF
-                __m128i g2 = _mm_mulhi_epu16(_mm_and_si128(dst, gMask1), a2); //0x0000FF00 -> 0x000000FF
-
-                //add multiplied source and destination color channels
-                __m128i rb = _mm_and_si128(_mm_add_epi32(rb1, rb2), rbMask2);
-                __m128i g = _mm_slli_epi32(_mm_add_epi32(g1, g2), 16);
-
-                //recombine color channels and shift into place (destination alpha can be left as 0 since it's not used)
-                __m128i c = _mm_srli_epi32(_mm_or_si128(rb, g), 8);
-                _mm_storeu_si128((__m128i *) &canvas[miny + y][minx + x], c);
-            }
-        }
-    #else
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; ++x) {
-                unsafe_blend(canvas, minx + x, miny + y, pixels[(srcy + y) * pitch + srcx + x]);
-            }
-        }
-    #endif
+    _blit(canvas, pixels, width, height, pitch, cx, cy, BLEND_OVER, SOURCE_COPY);
 }
 
-static inline void _draw_sprite_flip(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy, int flip) {
-    //destination coords
-    int minx = imax(0, cx);
-    int miny = imax(0, cy);
-    int maxx = imin(canvas.width, cx + width);
-    int maxy = imin(canvas.height, cy + height);
-
-    if (minx >= maxx || miny >= maxy) return;
-
-    //source coords
-    int srcx = minx - cx;
-    int srcy = miny - cy;
-    int srcw = maxx - minx;
-    int srch = maxy - miny;
-
-    if (flip)
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; ++x) {
-                unsafe_blend(canvas, minx + x, miny + y, pixels[(srcy + y) * pitch + srcx + srcw - x]);
-            }
-        }
-    else
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; ++x) {
-                unsafe_blend(canvas, minx + x, miny + y, pixels[(srcy + y) * pitch + srcx + x]);
-            }
-        }
+static inline void _draw_sprite_flip(Canvas & canvas, Pixel * pixels, int width, int height, int pitch,
+    int cx, int cy, int flip)
+{
+    _blit(canvas, pixels, width, height, pitch, cx, cy, BLEND_OVER, SOURCE_COPY, flip);
 }
 
 static inline void draw_sprite(Canvas & canvas, Image & image, int cx, int cy) {
-    _draw_sprite(canvas, image.pixels, image.width, image.height, image.width, cx, cy);
+    _draw_sprite(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy);
+}
+
+static inline void draw_sprite_flip(Canvas & canvas, Image & image, int cx, int cy, int flip) {
+    _draw_sprite_flip(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy, flip);
 }
 
 static inline
 void _draw_sprite(Canvas & canvas, Pixel * pixels, int width, int height, int pitch, int cx, int cy, float alpha) {
-    //destination coords
-    int minx = imax(0, cx);
-    int miny = imax(0, cy);
-    int maxx = imin(canvas.width, cx + width);
-    int maxy = imin(canvas.height, cy + height);
+    _blit(canvas, pixels, width, height, pitch, cx, cy, BLEND_OVER, SOURCE_ALPHA, false, alpha);
+}
 
-    if (minx >= maxx || miny >= maxy) return;
+static inline void draw_sprite(Canvas & canvas, Image & image, int cx, int cy, float alpha) {
+    _draw_sprite(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy, alpha);
+}
 
-    //source coords
-    int srcx = minx - cx;
-    int srcy = miny - cy;
-    int srcw = maxx - minx;
-    int srch = maxy - miny;
-
-    #ifdef SSE_BLIT
-        const __m128i alpha16 = _mm_set1_epi16(alpha * 255);
-        const __m128i iSrcw = _mm_set1_epi32(srcw);
-        const __m128i i3210 = _mm_set_epi32(3, 2, 1, 0);
-        const __m128i allo = (__m128i) _mm_setr_epi32(0xff03ff03, 0xff03ff03, 0xff07ff07, 0x0ff7ff07);
-        const __m128i alhi = (__m128i) _mm_setr_epi32(0xff0bff0b, 0xff0bff0b, 0xff0fff0f, 0x0fffff0f);
-        const __m128i zero = (__m128i) _mm_setr_epi32(0x00000000, 0x00000000, 0x00000000, 0x00000000);
-        const __m128i i255 = (__m128i) _mm_setr_epi32(0xff00ff00, 0xff00ff00, 0xff00ff00, 0xff00ff00);
-
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; x += 4) {
-                __m128i inclusionMask = _mm_cmplt_epi32(_mm_add_epi32(i3210, _mm_set1_epi32(x)), iSrcw);
-
-                Pixel * canvSrc = &canvas[miny + y][minx + x];
-                __m128i under = _mm_loadu_si128((__m128i *) canvSrc);
-                Pixel * imgSrc = &pixels[(srcy + y) * pitch + srcx + x];
-                __m128i over = _mm_and_si128(_mm_loadu_si128((__m128i *) imgSrc), inclusionMask);
-
-                __m128i under0 = _mm_cvtepu8_epi16(under); //@SSE4.1
-                __m128i under1 = _mm_unpackhi_epi8(under, zero);
-                __m128i over0 = _mm_cvtepu8_epi16(over); //@SSE4.1
-                __m128i over1 = _mm_unpackhi_epi8(over, zero);
-                __m128i alpha0 = _mm_mullo_epi16(_mm_shuffle_epi8(over, allo), alpha16); //@SSSE3
-                __m128i alpha1 = _mm_mullo_epi16(_mm_shuffle_epi8(over, alhi), alpha16); //@SSSE3
-                __m128i invAlpha0 = _mm_sub_epi8(i255, alpha0);
-                __m128i invAlpha1 = _mm_sub_epi8(i255, alpha1);
-                __m128i underMul0 = _mm_mulhi_epu16(under0, invAlpha0);
-                __m128i underMul1 = _mm_mulhi_epu16(under1, invAlpha1);
-                __m128i overMul0 = _mm_mulhi_epu16(over0, alpha0);
-                __m128i overMul1 = _mm_mulhi_epu16(over1, alpha1);
-                __m128i underFinal = _mm_packus_epi16(underMul0, underMul1);
-                __m128i overFinal = _mm_packus_epi16(overMul0, overMul1);
-                __m128i c = _mm_adds_epu8(overFinal, underFinal);
-                _mm_storeu_si128((__m128i *) canvSrc, c);
-            }
-        }
-    #else
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; ++x) {
-                Color color = pixels[(srcy + y) * pitch + srcx + x];
-                color.a *= alpha;
-                unsafe_blend(canvas, minx + x, miny + y, color);
-            }
-        }
-    #endif
+static inline void draw_sprite_blend(Canvas & canvas, Image & image, int cx, int cy, BlendMode blend) {
+    _blit(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy, blend, SOURCE_COPY);
 }
 
-static inline void draw_sprite(Canvas & canvas, Image & image, int cx, int cy, float alpha) {
-    _draw_sprite(canvas, image.pixels, image.width, image.height, image.width, cx, cy, alpha);
+static inline void draw_sprite_tinted(Canvas & canvas, Image & image, int cx, int cy, Color tint,
+    BlendMode blend = BLEND_OVER)
+{
+    _blit(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy, blend, SOURCE_TINT, false, 1, tint);
 }
 
 static inline void _draw_sprite_silhouette(Canvas & canvas, Pixel * pixels,
     int width, int height, int pitch, int cx, int cy, Color fill)
 {
-    //destination coords
-    int minx = imax(0, cx);
-    int miny = imax(0, cy);
-    int maxx = imin(canvas.width, cx + width);
-    int maxy = imin(canvas.height, cy + height);
-
-    //source coords
-    int srcx = minx - cx;
-    int srcy = miny - cy;
-    int srcw = maxx - minx;
-    int srch = maxy - miny;
-
-    // #ifdef SSE_BLIT
-    #if 0 //TODO: SSE version
-        const __m128i iSrcw = _mm_set1_epi32(srcw);
-        const __m128i i3210 = _mm_set_epi32(3, 2, 1, 0);
-        const __m128i zero = (__m128i) _mm_set1_epi32(0);
-
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; x += 4) {
-                __m128i ix = _mm_add_epi32(i3210, _mm_set1_epi32(x));
-                __m128i inclusionMask = _mm_cmplt_epi32(ix, iSrcw);
-
-                Pixel * canvSrc = &canvas[miny + y][minx + x];
-                __m128i src = _mm_loadu_si128((__m128i *) canvSrc);
-                Pixel * imgSrc = &pixels[(srcy + y) * pitch + srcx + x];
-                __m128i img = _mm_loadu_si128((__m128i *) imgSrc);
-
-                __m128i alphaMask = _mm_and_si128(_mm_cmplt_epi32(img, zero), inclusionMask);
-                __m128i c = _mm_blendv_epi8(src, img, alphaMask);
-                _mm_storeu_si128((__m128i *) canvSrc, c);
-            }
-        }
-    #else
-        for (int y = 0; y < srch; ++y) {
-            for (int x = 0; x < srcw; ++x) {
-                Color c = pixels[(srcy + y) * pitch + srcx + x];
-                if (c.a > 127) {
-                    unsafe_blend(canvas, minx + x, miny + y, fill);
-                }
-            }
-        }
-    #endif
+    _blit(canvas, pixels, width, height, pitch, cx, cy, BLEND_OVER, SOURCE_FILL, false, 1, fill);
 }
 
 static inline void draw_sprite_silhouette(Canvas & canvas, Image & image, int cx, int cy, Color fill) {
-    _draw_sprite_silhouette(canvas, image.pixels, image.width, image.height, image.width, cx, cy, fill);
+    _draw_sprite_silhouette(canvas, image.pixels, image.width, image.height, image.pitch, cx, cy, fill);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// RUN SPRITES                                                                                                      ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+enum RunKind : u8 {
+    RUN_SKIP,   //fully transparent, never stored since the gaps between runs are skipped anyway
+    RUN_COPY,   //opaque, copied straight into the canvas
+    RUN_BLEND,  //translucent, blended over the canvas
+    RUN_CUTOUT, //translucent but passing the alpha test, drawn opaque like SOURCE_CUTOUT does
+};
+
+struct SpriteRun {
+    u16 x, width;
+    RunKind kind;
+};
+
+//a sprite with each row split into runs of pixels that get drawn the same way, so that drawing it
+//costs time in proportion to how much of it is visible rather than to its bounding box
+//NOTE: the image is referenced, not copied, so it must outlive the sprite and mustn't change after encoding
+struct RunSprite {
+    Image image;
+    List<SpriteRun> runs;
+    List<int> rows; //index of each row's first run, plus one more entry for the end of the last row
+    u32 serial; //from new_image_serial(), since the same image can make two different sprites
+};
+
+//with `alphaTest` set, the sprite draws exactly like draw_sprite_a1() (pixels with alpha above 127 drawn opaque),
+//otherwise it draws like draw_sprite() (blended over the canvas)
+//NOTE: in the latter case, opaque runs also overwrite destination alpha with 255, which blending wouldn't do
+RunSprite make_run_sprite(Image & image, bool alphaTest);
+void draw_run_sprite(Canvas & canvas, RunSprite & sprite, int cx, int cy);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// TILESET OPS                                                                                                      ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -326,12 +454,12 @@ static inline Tileset load_tileset(const char * filepath, int tileWidth, int til
 
 static inline void draw_tile(Canvas & canvas, Tileset & set, int tx, int ty, int cx, int cy) {
     _draw_sprite(canvas,
-        &set.image[ty * set.tileHeight][tx * set.tileWidth], set.tileWidth, set.tileHeight, set.image.width, cx, cy);
+        &set.image[ty * set.tileHeight][tx * set.tileWidth], set.tileWidth, set.tileHeight, set.image.pitch, cx, cy);
 }
 
 static inline void draw_tile_a1(Canvas & canvas, Tileset & set, int tx, int ty, int cx, int cy) {
     _draw_sprite_a1(canvas,
-        &set.image[ty * set.tileHeight][tx * set.tileWidth], set.tileWidth, set.tileHeight, set.image.width, cx, cy);
+        &set.image[ty * set.tileHeight][tx * set.tileWidth], set.tileWidth, set.tileHeight, set.image.pitch, cx, cy);
 }
 
 static inline void draw_animation(Canvas & canvas, Tileset & set, int cx, int cy, float anim_timer) {
@@ -343,7 +471,7 @@ static inline void draw_animation(Canvas & canvas, Tileset & set, int cx, int cy
 
 static inline void draw_tile_silhouette(Canvas & canvas, Tileset & set, int tx, int ty, int cx, int cy, Color fill) {
     _draw_sprite_silhouette(canvas, &set.image[ty * set.tileHeight][tx * set.tileWidth],
-        set.tileWidth, set.tileHeight, set.image.width, cx, cy, fill);
+        set.tileWidth, set.tileHeight, set.image.pitch, cx, cy, fill);
 }
 
 static inline void draw_animation_silhouette(Canvas & canvas,
@@ -360,15 +488,17 @@ static inline void draw_animation_silhouette(Canvas & canvas,
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 static inline void draw_rect(Canvas & canvas, int x, int y, int w, int h, Color color) {
-    int minx = imax(0, x);
-    int miny = imax(0, y);
-    int maxx = imin(canvas.width, x + w);
-    int maxy = imin(canvas.height, y + h);
-    for (int y = miny; y < maxy; ++y) {
-        for (int x = minx; x < maxx; ++x) {
-            unsafe_blend(canvas, x, y, color);
-        }
-    }
+    if (color.a == 0) return;
+    Bounds b = intersect(canvas.clip, bounds(x, y, w, h));
+    mark_dirty(canvas, b);
+    _fill(canvas, b, BLEND_OVER, color);
+}
+
+//like draw_rect(), but overwrites pixels instead of blending with them
+static inline void fill_rect(Canvas & canvas, int x, int y, int w, int h, Color color) {
+    Bounds b = intersect(canvas.clip, bounds(x, y, w, h));
+    mark_dirty(canvas, b);
+    _fill(canvas, b, BLEND_REPLACE, color);
 }
 
 static inline void draw_line(Canvas & canvas, int x1, int y1, int x2, int y2, Color color) {
@@ -383,6 +513,7 @@ static inline void draw_line(Canvas & canvas, int x1, int y1, int x2, int y2, Co
     int x = x1;
     int y = y1;
 
+    mark_dirty(canvas, intersect(canvas.clip, { imin(x1, x2), imin(y1, y2), imax(x1, x2) + 1, imax(y1, y2) + 1 }));
     while (true) {
         blend(canvas, x, y, color);
 
@@ -397,111 +528,46 @@ static inline void draw_line(Canvas & canvas, int x1, int y1, int x2, int y2, Co
     }
 }
 
-static inline void draw_oval(Canvas & canvas, int x0, int y0, int w, int h, Color color) {
-    int minx = imax(0, x0 - w);
-    int miny = imax(0, y0 - h);
-    int maxx = imin(canvas.width, x0 + w);
-    int maxy = imin(canvas.height, y0 + h);
-    if (maxx < minx || maxy < miny) return;
-    float xfactor = 1.0f / w;
-    float yfactor = 1.0f / h;
-    if (color.a < 250) {
-        for (int y = miny; y <= maxy; ++y) {
-            for (int x = minx; x <= maxx; ++x) {
-                float dx = (x - x0 + 0.5f) * xfactor;
-                float dy = (y - y0 + 0.5f) * yfactor;
-                if (dx * dx + dy * dy < 1) {
-                    unsafe_blend(canvas, x, y, color);
-                }
-            }
-        }
-    } else {
-        for (int y = miny; y <= maxy; ++y) {
-            for (int x = minx; x <= maxx; ++x) {
-                float dx = (x - x0 + 0.5f) * xfactor;
-                float dy = (y - y0 + 0.5f) * yfactor;
-                if (dx * dx + dy * dy < 1) {
-                    canvas.pixels[y * canvas.pitch + x] = color;
-                }
-            }
-        }
-    }
-}
-
-static inline void draw_oval_add(Canvas & canvas, int x0, int y0, int w, int h, Color color) {
-    int minx = imax(0, x0 - w);
-    int miny = imax(0, y0 - h);
-    int maxx = imin(canvas.width, x0 + w);
-    int maxy = imin(canvas.height, y0 + h);
-    if (maxx < minx || maxy < miny) return;
-    float xfactor = 1.0f / w;
-    float yfactor = 1.0f / h;
-    for (int y = miny; y <= maxy; ++y) {
-        for (int x = minx; x <= maxx; ++x) {
-            float dx = (x - x0 + 0.5f) * xfactor;
-            float dy = (y - y0 + 0.5f) * yfactor;
-            if (dx * dx + dy * dy < 1) {
-                unsafe_blend_add(canvas, x, y, color);
-            }
-        }
-    }
-}
-
+//NOTE: ovals and lights cover pixels whose centers lie strictly inside the ellipse with radii `w` and `h`
+void draw_oval(Canvas & canvas, int x0, int y0, int w, int h, Color color);
+void draw_oval_add(Canvas & canvas, int x0, int y0, int w, int h, Color color);
 void add_light(Canvas & canvas, int x0, int y0, int w, int h, Color color);
 
-static inline void draw_triangle(Canvas & canvas, int x1, int y1, int x2, int y2, int x3, int y3, Color c) {
-    int minx = imax(0, imin(x1, imin(x2, x3)));
-    int miny = imax(0, imin(y1, imin(y2, y3)));
-    int maxx = imin(canvas.width - 1, imax(x1, imax(x2, x3)));
-    int maxy = imin(canvas.height - 1, imax(y1, imax(y2, y3)));
-    for (int y = miny; y <= maxy; ++y) {
-        for (int x = minx; x <= maxx; ++x) {
-            int w0 = cross(coord2(x, y) - coord2(x1, y1), coord2(x2, y2) - coord2(x1, y1));
-            int w1 = cross(coord2(x, y) - coord2(x2, y2), coord2(x3, y3) - coord2(x2, y2));
-            int w2 = cross(coord2(x, y) - coord2(x3, y3), coord2(x1, y1) - coord2(x3, y3));
-            if ((w0 >= 0 && w1 >= 0 && w2 >= 0) || (w0 <= 0 && w1 <= 0 && w2 <= 0)) {
-                canvas[y][x] = c;
-            }
-        }
-    }
-}
+//NOTE: covers the pixels whose (integer) coordinates lie inside or on the edge of the triangle, in either winding order
+void draw_triangle(Canvas & canvas, int x1, int y1, int x2, int y2, int x3, int y3, Color c);
 
+//U and V are in pixel coordinates, not normalize [0,1] coordinates
 void draw_textured_triangle(Canvas & canvas, Image & tex,
     int x1, int y1, int u1, int v1,
     int x2, int y2, int u2, int v2,
     int x3, int y3, int u3, int v3);
 
-static inline void draw_transformed_sprite(Canvas & canvas, Image & sprite, Vec2 pos, float rotation, Vec2 scale) {
-    float hw = sprite.width * 0.5f;
-    float hh = sprite.height * 0.5f;
-    Vec2 verts[4] = { vec2(-hw, -hh), vec2(hw, -hh), vec2(hw, hh), vec2(-hw, hh) };
-    Mat2 mat = rotate(rotation);
-    for (Vec2 & v : verts) {
-        v = mat * (v * scale) + pos;
-    }
-    draw_textured_triangle(canvas, sprite,
-        verts[0].x, verts[0].y, 0, 0,
-        verts[1].x, verts[1].y, sprite.width, 0,
-        verts[2].x, verts[2].y, sprite.width, sprite.height);
-    draw_textured_triangle(canvas, sprite,
-        verts[0].x, verts[0].y, 0, 0,
-        verts[2].x, verts[2].y, sprite.width, sprite.height,
-        verts[3].x, verts[3].y, 0, sprite.height);
-}
+//rotates the sprite around its center and scales it, then draws it centered on `pos`
+//NOTE: this walks each destination row with fixed-point texture coords, clipped to exactly the pixels the
+//      sprite covers, so the cost per pixel doesn't depend on the transform, and is only a gather away from a blit
+void draw_transformed_sprite(Canvas & canvas, Image & sprite, Vec2 pos, float rotation, Vec2 scale,
+    SampleMode sample = SAMPLE_NEAREST);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// FONT OPS                                                                                                         ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-//TODO: make font rendering use tileset ops?
-
+//NOTE: glyphs are pre-composed at load time into cells twice the glyph height, with the descender of
+//      'g', 'j', 'p', 'q' and 'y' already drawn into the bottom half, so text drawing is one blit per glyph
 struct MonoFont {
     u8 * pixels;
     int textureWidth, textureHeight;
     int glyphWidth, glyphHeight;
     int rows, columns;
+
+    Image cells; //one glyphWidth x (glyphHeight * 2) cell per glyph, laid out like the glyphs, coverage in alpha
+    struct Span { int top, bottom; } * spans; //rows of each cell that have any coverage, empty if top == bottom
 };
 
+static inline Pixel * glyph_cell(MonoFont & font, int glyph) {
+    return &font.cells[glyph / font.columns * font.glyphHeight * 2][glyph % font.columns * font.glyphWidth];
+}
+
 static inline MonoFont load_mono_font(const char * filepath, int rows, int columns) {
     int w, h, n;
     Pixel * pixels = (Pixel *) stbi_load(filepath, &w, &h, &n, 4);
@@ -523,49 +589,96 @@ static inline MonoFont load_mono_font(const char * filepath, int rows, int colum
     font.rows = rows;
     font.columns = columns;
 
+    int glyphs = rows * columns;
+    font.cells = { (Pixel *) calloc(w * h * 2 + 4, sizeof(Pixel)), w, h * 2, w };
+    font.spans = (MonoFont::Span *) malloc(glyphs * sizeof(MonoFont::Span));
+
+    //copies glyph `src` into rows [dsty, dsty + glyphHeight) of cell `dst`
+    auto compose = [&] (int dst, int src, int dsty) {
+        int srcx = src % columns * font.glyphWidth;
+        int srcy = src / columns * font.glyphHeight;
+        for (int y = 0; y < font.glyphHeight; ++y) {
+            for (int x = 0; x < font.glyphWidth; ++x) {
+                if (data[(srcy + y) * w + srcx + x]) {
+                    glyph_cell(font, dst)[(dsty + y) * font.cells.pitch + x] = { 255, 255, 255, 255 };
+                }
+            }
+        }
+    };
+
+    for (int i = 0; i < glyphs; ++i) {
+        compose(i, i, 0);
+
+        //descenders
+        if (i == 'g' || i == 'y') {
+            compose(i, 16, font.glyphHeight);
+        } else if (i == 'j') {
+            compose(i, 19, font.glyphHeight);
+        } else if (i == 'p') {
+            compose(i, 17, font.glyphHeight);
+        } else if (i == 'q') {
+            compose(i, 18, font.glyphHeight);
+        }
+
+        MonoFont::Span span = { 0, 0 };
+        for (int y = 0; y < font.glyphHeight * 2; ++y) {
+            for (int x = 0; x < font.glyphWidth; ++x) {
+                if (glyph_cell(font, i)[y * font.cells.pitch + x].a) {
+                    if (span.top == span.bottom) span.top = y;
+                    span.bottom = y + 1;
+                    break;
+                }
+            }
+        }
+        font.spans[i] = span;
+    }
+
     return font;
 }
 
-static inline void draw_glyph(Canvas & canvas, MonoFont & font, int cx, int cy, Color color, int glyph) {
-    int row = glyph / font.columns;
-    int col = glyph % font.columns;
-    int srcx = col * font.glyphWidth;
-    int srcy = row * font.glyphHeight;
+//draws the pre-composed cell, so descenders are included
+static inline void draw_glyph(Canvas & canvas, MonoFont & font, int cx, int cy, Color color, int glyph,
+    BlendMode blend = BLEND_OVER)
+{
+    if (glyph < 0 || glyph >= font.rows * font.columns) return;
+    MonoFont::Span span = font.spans[glyph];
+    if (span.top == span.bottom) return;
 
     //HACK
     if (glyph == '?') color = { 120, 128, 110, 255 };
 
-    //"blit" glyph to the screen
-    for (int y = 0; y < font.glyphHeight; ++y) {
-        for (int x = 0; x < font.glyphWidth; ++x) {
-            int idx = (srcy + y) * font.textureWidth + (srcx + x);
-            if (font.pixels[idx]) {
-                blend(canvas, cx + x, cy + y, color);
-            }
-        }
-    }
+    Pixel * cell = glyph_cell(font, glyph);
+    _blit(canvas, cell + span.top * font.cells.pitch, font.glyphWidth, span.bottom - span.top, font.cells.pitch,
+        cx, cy + span.top, blend, SOURCE_FILL, false, 1, color);
 }
 
-static inline void draw_text(Canvas & canvas, MonoFont & font, int cx, int cy, Color color, const char * text) {
+static inline void draw_text(Canvas & canvas, MonoFont & font, int cx, int cy, Color color, const char * text,
+    BlendMode blend = BLEND_OVER)
+{
     //HACK
     if (!strncmp(text, " ERROR:", strlen(" ERROR:"))) color = { 248, 166, 136, 255 };
 
     for (int i = 0; text[i] != '\0'; ++i) {
-        draw_glyph(canvas, font, cx + i * font.glyphWidth, cy, color, text[i]);
-
-        //draw extenders
-        if (text[i] == 'g' || text[i] == 'y') {
-            draw_glyph(canvas, font, cx + i * font.glyphWidth, cy + font.glyphHeight, color, 16);
-        } else if (text[i] == 'j') {
-            draw_glyph(canvas, font, cx + i * font.glyphWidth, cy + font.glyphHeight, color, 19);
-        } else if (text[i] == 'p') {
-            draw_glyph(canvas, font, cx + i * font.glyphWidth, cy + font.glyphHeight, color, 17);
-        } else if (text[i] == 'q') {
-            draw_glyph(canvas, font, cx + i * font.glyphWidth, cy + font.glyphHeight, color, 18);
-        }
+        draw_glyph(canvas, font, cx + i * font.glyphWidth, cy, color, (u8) text[i], blend);
     }
 }
 
+//renders a line of text once into an image that draw_text_strip() can composite in a single blit,
+//for text that doesn't change but gets drawn every frame
+//NOTE: the strip stores final colors rather than coverage, so this only matches draw_text() for opaque colors
+static inline Image render_text_strip(MonoFont & font, Color color, const char * text) {
+    int width = strlen(text) * font.glyphWidth;
+    Image strip = { (Pixel *) calloc(width * font.glyphHeight * 2 + 1, sizeof(Pixel)), width, font.glyphHeight * 2, width,
+        new_image_serial() };
+    Canvas canvas = { strip.pixels, strip.width, strip.height, strip.pitch, 0, bounds(0, 0, strip.width, strip.height) };
+    draw_text(canvas, font, 0, 0, color, text, BLEND_REPLACE);
+    return strip;
+}
+
+static inline void draw_text_strip(Canvas & canvas, Image & strip, int cx, int cy) {
+    _blit(canvas, strip.pixels, strip.width, strip.height, strip.pitch, cx, cy, BLEND_OVER, SOURCE_CUTOUT);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// CANVAS OPS                                                                                                       ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -579,81 +692,34 @@ static inline Canvas make_canvas(int width, int height, int margin) {
     Pixel * canvasData = (Pixel *) malloc(canvasBytes);
     Canvas canvas = {
         canvasData + margin * (width + 2 * margin) + margin,
-        width, height, width + 2 * margin, margin
+        width, height, width + 2 * margin, margin, bounds(0, 0, width, height),
+        (DirtyList *) calloc(1, sizeof(DirtyList)),
     };
     //fill whole canvas, including margins, with solid black
     memset(canvasData, 0, canvasBytes);
     return canvas;
 }
 
-//TODO: improve pixel blending by using an SRGB texture
-static inline void draw_canvas(int shader, Canvas & canvas, float ww, float wh) {
+//owns the GL objects used to put a canvas on screen, so they aren't recreated every frame
+//NOTE: uploads go through a ring of pixel unpack buffers, so that writing this frame's pixels
+//      never has to wait on the GPU to finish reading the ones uploaded in the last couple frames
+#define CANVAS_UPLOAD_BUFFERS 3
+struct CanvasPresenter {
+    uint shader;
     uint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int w = canvas.width + canvas.margin * 2, h = canvas.height + canvas.margin * 2;
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, canvas.basePointer());
-
-    //NOTE: this still doesn't actually work to get rid of scaling artifacts
-    //      except at 2x scale where it kinda sorta accidentally mostly works by happenstance
-    float u1 = canvas.margin / (float) w - 0.5f / ww;
-    float v1 = canvas.margin / (float) h - 0.5f / wh;
-    float u2 = 1 - u1 - 1.0f / ww;
-    float v2 = 1 - v1 - 1.0f / wh;
-
-    float x = fminf(1, (wh / ww) / (canvas.height / (float) canvas.width));
-    float y = fminf(1, (ww / wh) / (canvas.width / (float) canvas.height));
-
-    struct TexVert { Vec2 pos, uv; };
-    TexVert verts[6] = {
-        { vec2(-x,  y), vec2(u1, v1) },
-        { vec2( x,  y), vec2(u2, v1) },
-        { vec2( x, -y), vec2(u2, v2) },
-        { vec2(-x,  y), vec2(u1, v1) },
-        { vec2( x, -y), vec2(u2, v2) },
-        { vec2(-x, -y), vec2(u1, v2) },
-    };
-
     uint vao, vbo;
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_DYNAMIC_DRAW);
-
-    //setup vertex attributes
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TexVert), (void *) offsetof(TexVert, pos));
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TexVert), (void *) offsetof(TexVert, uv));
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-
-    //bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex);
-
-    //set uniforms and draw
-    glUseProgram(shader);
-    int texSizeLoc = glGetUniformLocation(shader, "texSize");
-    glUniform2f(texSizeLoc, w, h);
-    int scaleLoc = glGetUniformLocation(shader, "scale");
-    float scale = fminf(ww / canvas.width, wh / canvas.height);
-    glUniform1f(scaleLoc, scale);
-    glDrawArrays(GL_TRIANGLES, 0, ARR_SIZE(verts));
-
-    //delete temp resources
-    glDeleteTextures(1, &tex);
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
-
-    gl_error("draw_canvas()");
-}
+    uint pbo[CANVAS_UPLOAD_BUFFERS];
+    int nextPbo;
+    int texWidth, texHeight; //includes the canvas margin
+    float ww, wh; //window size the vertex buffer was last built for
+    int texSizeLoc, scaleLoc;
+};
+
+//uploads the whole canvas (including margins) once, after that only dirty rows are uploaded
+CanvasPresenter make_canvas_presenter(uint shader, Canvas & canvas);
+void free_canvas_presenter(CanvasPresenter & presenter);
+
+//NOTE: call this before clear_dirty(), since the dirty list is what decides which rows get uploaded
+void draw_canvas(CanvasPresenter & presenter, Canvas & canvas, float ww, float wh);
 
 #endif //PIXEL_HPP
@@ -0,0 +1,357 @@
+#include "post.hpp"
+
+//NOTE: like the blit backends, the AVX2 paths are enabled per-function and only used once select_blit_backend()
+//      has found that the CPU supports them. SSE2 is baseline x86-64, so there's no scalar path
+//NOTE: both paths do the exact same integer sums and float scaling, so they give bit-identical results
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline bool use_avx2() {
+    return blitBackend == &blitBackends[BLIT_AVX2];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BOX BLUR PASSES                                                                                                  ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//each pass keeps a running sum of the `2 * radius + 1` pixels under the window, in 32-bit lanes (one per channel),
+//adding the pixel entering the window and subtracting the one leaving it, then scales the sum by 1 / window size.
+//the sum can't overflow, since even a window of 255 white pixels only adds up to 16 bits
+
+static inline __m128i widen(Pixel p) {
+    u32 u; memcpy(&u, &p, 4);
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(u), zero), zero);
+}
+
+static inline __m128i scale(__m128i sum, __m128 factor) {
+    return _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(sum), factor));
+}
+
+static inline Pixel narrow(__m128i v) {
+    v = _mm_packs_epi32(v, v);
+    u32 u = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+    Pixel p; memcpy(&p, &u, 4);
+    return p;
+}
+
+//horizontal pass, one pixel (four channels) at a time
+static void blur_rows_sse2(Canvas & dst, Canvas & src, int radius) {
+    __m128 factor = _mm_set1_ps(1.0f / (radius * 2 + 1));
+    for (int y = 0; y < src.height; ++y) {
+        Pixel * in = src[y];
+        Pixel * out = dst[y];
+        __m128i sum = _mm_setzero_si128();
+        for (int x = -radius; x < radius; ++x) sum = _mm_add_epi32(sum, widen(in[x]));
+        for (int x = 0; x < src.width; ++x) {
+            sum = _mm_add_epi32(sum, widen(in[x + radius]));
+            out[x] = narrow(scale(sum, factor));
+            sum = _mm_sub_epi32(sum, widen(in[x - radius]));
+        }
+    }
+}
+
+AVX2 static inline __m256i widen2(Pixel * a, Pixel * b) {
+    u32 ua, ub; memcpy(&ua, a, 4); memcpy(&ub, b, 4);
+    return _mm256_cvtepu8_epi32(_mm_unpacklo_epi32(_mm_cvtsi32_si128(ua), _mm_cvtsi32_si128(ub)));
+}
+
+AVX2 static inline __m256i scale2(__m256i sum, __m256 factor) {
+    return _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(sum), factor));
+}
+
+//horizontal pass, two rows at a time, one in each 128-bit half
+AVX2 static void blur_rows_avx2(Canvas & dst, Canvas & src, int radius) {
+    __m256 factor = _mm256_set1_ps(1.0f / (radius * 2 + 1));
+    for (int y = 0; y < src.height; y += 2) {
+        //for an odd height, the last pair's second row is in the margin, so it's safe to read but not to write
+        bool pair = y + 1 < src.height;
+        Pixel * in0 = src[y], * in1 = src[y + 1];
+        Pixel * out0 = dst[y], * out1 = dst[y + 1];
+        __m256i sum = _mm256_setzero_si256();
+        for (int x = -radius; x < radius; ++x) sum = _mm256_add_epi32(sum, widen2(in0 + x, in1 + x));
+        for (int x = 0; x < src.width; ++x) {
+            sum = _mm256_add_epi32(sum, widen2(in0 + x + radius, in1 + x + radius));
+            __m256i v = scale2(sum, factor);
+            v = _mm256_packs_epi32(v, v);
+            v = _mm256_packus_epi16(v, v);
+            u32 u0 = _mm256_extract_epi32(v, 0), u1 = _mm256_extract_epi32(v, 4);
+            memcpy(out0 + x, &u0, 4);
+            if (pair) memcpy(out1 + x, &u1, 4);
+            sum = _mm256_sub_epi32(sum, widen2(in0 + x - radius, in1 + x - radius));
+        }
+    }
+}
+
+//the vertical passes keep one running sum per channel for the whole row, and slide it down the canvas,
+//so they walk memory in order and are vectorized across neighboring pixels instead
+//NOTE: the last few pixels of each row go through a temporary, to leave the margin to the right untouched
+//NOTE: the sums are stored as plain ints, four per pixel, because templates drop the vector types' attributes
+static List<int> columnSums;
+
+static __m128i * reset_column_sums(int pixels) {
+    columnSums.len = 0;
+    for (int i = 0; i < pixels * 4; ++i) columnSums.add(0);
+    return (__m128i *) columnSums.data;
+}
+
+//partial loads and stores go through a temporary, so the margin to the right is never touched
+static inline __m128i load4_n(const Pixel * p, int n) {
+    if (n == 4) return _mm_loadu_si128((__m128i *) p);
+    Pixel tmp[4] = {};
+    memcpy(tmp, p, n * sizeof(Pixel));
+    return _mm_loadu_si128((__m128i *) tmp);
+}
+
+static inline void store4_n(Pixel * p, __m128i v, int n) {
+    if (n == 4) return _mm_storeu_si128((__m128i *) p, v);
+    Pixel tmp[4];
+    _mm_storeu_si128((__m128i *) tmp, v);
+    memcpy(p, tmp, n * sizeof(Pixel));
+}
+
+static inline void widen4(__m128i v, __m128i p[4]) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+    p[0] = _mm_unpacklo_epi16(lo, zero);
+    p[1] = _mm_unpackhi_epi16(lo, zero);
+    p[2] = _mm_unpacklo_epi16(hi, zero);
+    p[3] = _mm_unpackhi_epi16(hi, zero);
+}
+
+//four pixels at a time
+static void blur_columns_sse2(Canvas & dst, Canvas & src, int radius) {
+    __m128 factor = _mm_set1_ps(1.0f / (radius * 2 + 1));
+    __m128i * columns = reset_column_sums((src.width + 3) / 4 * 4);
+    __m128i p[4], q[4];
+    for (int y = -radius; y < radius; ++y) {
+        for (int x = 0; x < src.width; x += 4) {
+            widen4(load4_n(src[y] + x, imin(4, src.width - x)), p);
+            for (int i = 0; i < 4; ++i) columns[x + i] = _mm_add_epi32(columns[x + i], p[i]);
+        }
+    }
+    for (int y = 0; y < src.height; ++y) {
+        Pixel * entering = src[y + radius];
+        Pixel * leaving = src[y - radius];
+        Pixel * out = dst[y];
+        for (int x = 0; x < src.width; x += 4) {
+            int n = imin(4, src.width - x);
+            widen4(load4_n(entering + x, n), p);
+            widen4(load4_n(leaving + x, n), q);
+            __m128i * sums = columns + x;
+            for (int i = 0; i < 4; ++i) {
+                p[i] = _mm_add_epi32(sums[i], p[i]);
+                sums[i] = _mm_sub_epi32(p[i], q[i]);
+            }
+            store4_n(out + x, _mm_packus_epi16(_mm_packs_epi32(scale(p[0], factor), scale(p[1], factor)),
+                                               _mm_packs_epi32(scale(p[2], factor), scale(p[3], factor))), n);
+        }
+    }
+}
+
+AVX2 static inline __m256i load8_n(const Pixel * p, int n) {
+    if (n == 8) return _mm256_loadu_si256((__m256i *) p);
+    Pixel tmp[8] = {};
+    memcpy(tmp, p, n * sizeof(Pixel));
+    return _mm256_loadu_si256((__m256i *) tmp);
+}
+
+AVX2 static inline void store8_n(Pixel * p, __m256i v, int n) {
+    if (n == 8) return _mm256_storeu_si256((__m256i *) p, v);
+    Pixel tmp[8];
+    _mm256_storeu_si256((__m256i *) tmp, v);
+    memcpy(p, tmp, n * sizeof(Pixel));
+}
+
+AVX2 static inline void widen8(__m256i v, __m256i p[4]) {
+    __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+    p[0] = _mm256_cvtepu8_epi32(lo);
+    p[1] = _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8));
+    p[2] = _mm256_cvtepu8_epi32(hi);
+    p[3] = _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8));
+}
+
+//eight pixels at a time, two per register
+AVX2 static void blur_columns_avx2(Canvas & dst, Canvas & src, int radius) {
+    __m256 factor = _mm256_set1_ps(1.0f / (radius * 2 + 1));
+    __m256i * columns = (__m256i *) reset_column_sums((src.width + 7) / 8 * 8);
+    __m256i p[4], q[4];
+    for (int y = -radius; y < radius; ++y) {
+        for (int x = 0; x < src.width; x += 8) {
+            widen8(load8_n(src[y] + x, imin(8, src.width - x)), p);
+            __m256i * sums = columns + x / 2;
+            for (int i = 0; i < 4; ++i) {
+                _mm256_storeu_si256(sums + i, _mm256_add_epi32(_mm256_loadu_si256(sums + i), p[i]));
+            }
+        }
+    }
+    for (int y = 0; y < src.height; ++y) {
+        Pixel * entering = src[y + radius];
+        Pixel * leaving = src[y - radius];
+        Pixel * out = dst[y];
+        for (int x = 0; x < src.width; x += 8) {
+            int n = imin(8, src.width - x);
+            widen8(load8_n(entering + x, n), p);
+            widen8(load8_n(leaving + x, n), q);
+            __m256i * sums = columns + x / 2;
+            for (int i = 0; i < 4; ++i) {
+                p[i] = _mm256_add_epi32(_mm256_loadu_si256(sums + i), p[i]);
+                _mm256_storeu_si256(sums + i, _mm256_sub_epi32(p[i], q[i]));
+            }
+            //packing works within 128-bit halves, which leaves the pixels in the order 0 2 4 6 1 3 5 7
+            __m256i lo = _mm256_packs_epi32(scale2(p[0], factor), scale2(p[1], factor));
+            __m256i hi = _mm256_packs_epi32(scale2(p[2], factor), scale2(p[3], factor));
+            __m256i v = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi),
+                                                    _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+            store8_n(out + x, v, n);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BLURS                                                                                                            ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void box_blur(Canvas & canvas, Canvas & temp, int radiusX, int radiusY) {
+    assert(canvas.width == temp.width && canvas.height == temp.height);
+    assert(radiusX >= 0 && radiusX <= imin(canvas.margin, temp.margin));
+    assert(radiusY >= 0 && radiusY <= imin(canvas.margin, temp.margin));
+    if (use_avx2()) {
+        blur_rows_avx2(temp, canvas, radiusX);
+        blur_columns_avx2(canvas, temp, radiusY);
+    } else {
+        blur_rows_sse2(temp, canvas, radiusX);
+        blur_columns_sse2(canvas, temp, radiusY);
+    }
+}
+
+//radii of the three box blurs whose combined variance is closest to sigma^2,
+//see http://blog.ivank.net/fastest-gaussian-blur.html
+static void gaussian_boxes(float sigma, int radii[3]) {
+    if (sigma <= 0) {
+        radii[0] = radii[1] = radii[2] = 0;
+        return;
+    }
+    int lower = sqrtf(12 * sigma * sigma / 3 + 1);
+    if (lower % 2 == 0) lower -= 1;
+    int upper = lower + 2;
+    float idealCount = (12 * sigma * sigma - 3 * lower * lower - 12 * lower - 9) / (-4.0f * lower - 4);
+    int count = idealCount + 0.5f;
+    for (int i = 0; i < 3; ++i) {
+        radii[i] = ((i < count? lower : upper) - 1) / 2;
+    }
+}
+
+void gaussian_blur(Canvas & canvas, Canvas & temp, float sigmaX, float sigmaY) {
+    int radiiX[3], radiiY[3];
+    gaussian_boxes(sigmaX, radiiX);
+    gaussian_boxes(sigmaY, radiiY);
+    for (int i = 0; i < 3; ++i) {
+        box_blur(canvas, temp, radiiX[i], radiiY[i]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BLOOM                                                                                                            ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//(c - threshold) * 255 / (255 - threshold), with the multiplier rounded up so that full brightness stays at 255
+//NOTE: the product is at most (255 - threshold) * ceil(65280 / (255 - threshold)) <= 65535, so it fits in 16 bits
+void extract_bright(Canvas & dst, Canvas & src, u8 threshold) {
+    assert(dst.width == src.width && dst.height == src.height);
+    threshold = imin(threshold, 254);
+    __m128i sub = _mm_set1_epi8(threshold);
+    __m128i mul = _mm_set1_epi16((255 * 256 + 254 - threshold) / (255 - threshold));
+    __m128i zero = _mm_setzero_si128();
+    for (int y = 0; y < src.height; ++y) {
+        Pixel * in = src[y];
+        Pixel * out = dst[y];
+        for (int x = 0; x < src.width; x += 4) {
+            int n = imin(4, src.width - x);
+            __m128i v = _mm_subs_epu8(load4_n(in + x, n), sub);
+            __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), mul), 8);
+            __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), mul), 8);
+            store4_n(out + x, _mm_packus_epi16(lo, hi), n);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// CRT                                                                                                              ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void prepare_crt_warp(CrtWarp & warp, Canvas & src) {
+    if (warp.samples.len && warp.width == src.width && warp.height == src.height && warp.pitch == src.pitch) return;
+    warp.width = src.width;
+    warp.height = src.height;
+    warp.pitch = src.pitch;
+    warp.samples.len = 0;
+
+    for (int y = 0; y < src.height; ++y) {
+        for (int x = 0; x < src.width; ++x) {
+            //bulge in normalized coords, where the screen spans [-1, 1] and the corners get pulled out past the edge
+            float u = (x + 0.5f) / src.width * 2 - 1;
+            float v = (y + 0.5f) / src.height * 2 - 1;
+            float su = u * (1 + warp.curvature * v * v);
+            float sv = v * (1 + warp.curvature * u * u);
+
+            //back to source pixels, anything past the edge of the glass is black
+            float sx = (su + 1) * 0.5f * src.width - 0.5f;
+            float sy = (sv + 1) * 0.5f * src.height - 0.5f;
+            if (sx < -1 || sx >= src.width || sy < -1 || sy >= src.height) {
+                warp.samples.add({});
+                continue;
+            }
+
+            //the scanlines are every other output row, with the dark gap on the odd ones. the source is drawn at 1:1,
+            //so a scanline is only 2 rows tall, and bending them with the bulge would stretch that to a fraction of
+            //a row past 2 near the edges, which aliases into moire instead of looking curved
+            float scan = 1 - warp.scanlines * (y & 1);
+            float vig = 1 - warp.vignette * fminf(1, (su * su + sv * sv) * 0.5f);
+            //24.8 fixed point, so the integer part picks the pixels and the fraction is the bilinear weight
+            int fx = floorf(sx * 256 + 0.5f), fy = floorf(sy * 256 + 0.5f);
+            warp.samples.add({ (fy >> 8) * src.pitch + (fx >> 8), (u8) (fx & 255), (u8) (fy & 255),
+                               (u16) (fmaxf(0, scan * vig) * 256 + 0.5f) });
+        }
+    }
+}
+
+//all lerps work on 16-bit channels with 8-bit weights that sum to 256, so they can't overflow,
+//and each one rounds to nearest so the image doesn't lose brightness to repeated truncation
+static inline __m128i lerp_weights(int w) {
+    return _mm_unpacklo_epi64(_mm_set1_epi16(256 - w), _mm_set1_epi16(w));
+}
+
+void apply_crt_warp(CrtWarp & warp, Canvas & dst, Canvas & src) {
+    assert(&dst != &src && dst.width == src.width && dst.height == src.height);
+    assert(src.margin >= 1);
+    prepare_crt_warp(warp, src);
+    __m128i zero = _mm_setzero_si128();
+    __m128i half = _mm_set1_epi16(128);
+    __m128i opaque = _mm_set1_epi32(0xFF000000);
+    CrtSample * sample = warp.samples.data;
+    for (int y = 0; y < dst.height; ++y) {
+        Pixel * out = dst[y];
+        for (int x = 0; x < dst.width; ++x, ++sample) {
+            //fetch the 2x2 block as two pairs of horizontally adjacent pixels
+            Pixel * p = src.pixels + sample->offset;
+            __m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) p), zero);
+            __m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (p + src.pitch)), zero);
+
+            //lerp vertically, leaving the left pixel in the low half and the right one in the high half
+            __m128i v = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16(256 - sample->fy)),
+                                      _mm_mullo_epi16(bottom, _mm_set1_epi16(sample->fy)));
+            v = _mm_srli_epi16(_mm_add_epi16(v, half), 8);
+
+            //then horizontally, by weighting both halves and adding them together
+            v = _mm_mullo_epi16(v, lerp_weights(sample->fx));
+            v = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(v, _mm_srli_si128(v, 8)), half), 8);
+
+            //then darken, which can't overflow either since the gain is at most 256
+            v = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(v, _mm_set1_epi16(sample->gain)), half), 8);
+
+            u32 u = _mm_cvtsi128_si32(_mm_or_si128(_mm_packus_epi16(v, v), opaque));
+            memcpy(out + x, &u, 4);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef POST_HPP
+#define POST_HPP
+
+#include "pixel.hpp"
+
+//full-canvas effects that run after the scene has been drawn
+//NOTE: these read and write every pixel, so they don't respect the clip rect or mark anything dirty
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BLURS                                                                                                            ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//separable running-sum blurs, so the cost per pixel is the same no matter the radius
+//`temp` is scratch space that must be the same size as `canvas`, and the result ends up in `canvas`
+//NOTE: the blurs read up to `radius` pixels past the edges of the canvas, and rely on the margin being black there,
+//      so the radius of any single box pass can't exceed either canvas's margin. in return there are no edge cases
+//      in the inner loops, and the result fades out toward the edges as if the canvas were surrounded by darkness
+//NOTE: a radius of 0 leaves that axis untouched, so e.g. `box_blur(c, t, 6, 0)` only bleeds horizontally
+void box_blur(Canvas & canvas, Canvas & temp, int radiusX, int radiusY);
+
+//approximates a gaussian with three box blurs in a row, each with a radius of about `sigma`
+void gaussian_blur(Canvas & canvas, Canvas & temp, float sigmaX, float sigmaY);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// BLOOM                                                                                                            ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//keeps only the part of each channel above `threshold`, stretched back out to the full [0, 255] range
+//NOTE: `dst` and `src` must be the same size, but can be the same canvas
+void extract_bright(Canvas & dst, Canvas & src, u8 threshold);
+
+//adds `glow` (scaled by `intensity` in [0, 1]) onto the canvas, saturating
+//NOTE: this goes through the regular blit backend, so unlike the rest of this file it does mark the canvas dirty
+static inline void add_glow(Canvas & canvas, Canvas & glow, float intensity) {
+    _blit(canvas, glow.pixels, glow.width, glow.height, glow.pitch, 0, 0, BLEND_ADD, SOURCE_ALPHA, false, intensity);
+}
+
+//the scratch canvases a bloom pass needs, kept around so they don't get reallocated every frame
+struct Bloom {
+    Canvas glow;
+    Canvas temp;
+};
+
+//`maxSigma` is the widest blur the bloom will be asked to do, which decides how much margin the buffers need
+static inline Bloom make_bloom(int width, int height, float maxSigma) {
+    int margin = ceilf(maxSigma) + 1;
+    Bloom bloom = { make_canvas(width, height, margin), make_canvas(width, height, margin) };
+    //the scratch canvases are never presented, so there's no point tracking what changed on them
+    free(bloom.glow.dirty);
+    free(bloom.temp.dirty);
+    bloom.glow.dirty = bloom.temp.dirty = nullptr;
+    return bloom;
+}
+
+//makes everything brighter than `threshold` glow onto its surroundings
+static inline void apply_bloom(Canvas & canvas, Bloom & bloom, u8 threshold, float sigma, float intensity) {
+    extract_bright(bloom.glow, canvas, threshold);
+    gaussian_blur(bloom.glow, bloom.temp, sigma, sigma);
+    add_glow(canvas, bloom.glow, intensity);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// CRT                                                                                                              ///
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//where one output pixel samples the source from, and how much it gets darkened by
+struct CrtSample {
+    int offset; //of the top-left of the 2x2 pixels being filtered, relative to the source's first pixel
+    u8 fx, fy; //bilinear weights of the right and bottom pixels, out of 256
+    u16 gain; //scanline and vignette darkening combined, out of 256
+};
+
+//bulges the image outward like the glass of a CRT, with scanlines and a vignette on top
+//NOTE: the per-pixel math is all baked into a table, so applying the effect is just a bilinear fetch per pixel.
+//      the table depends on the source's size (and pitch), and gets rebuilt if that ever changes
+struct CrtWarp {
+    float curvature; //how far the corners get pulled in, as a fraction of the screen size
+    float scanlines; //how much the gaps between scanlines (every odd output row) get darkened, in [0, 1]
+    float vignette; //how much the corners get darkened, in [0, 1]
+
+    int width, height, pitch; //what the table was built for
+    List<CrtSample> samples;
+};
+
+static inline CrtWarp make_crt_warp(float curvature, float scanlines, float vignette) {
+    return { curvature, scanlines, vignette };
+}
+
+//rebuilds the table if `src` is not the size it was built for, which is the only expensive part of the effect
+void prepare_crt_warp(CrtWarp & warp, Canvas & src);
+
+//renders `src` through the CRT effect into `dst`, which must be a different canvas of the same size
+//NOTE: the source gets filtered a pixel past its edges, so it needs a margin of at least 1, which has to be black
+void apply_crt_warp(CrtWarp & warp, Canvas & dst, Canvas & src);
+
+#endif //POST_HPP
@@ -6,7 +6,9 @@ TODOs:
 - other sounds?
 - bleed/bloom (small and large radius blurs)
     - maybe the bleed only (or mostly) goes horizontal?
+    - there's an experimental bloom behind `--bloom` now, needs tuning
 - screen-space CRT bulge effect
+    - there's an experimental one behind `--crt` now, needs tuning
 - red error text?
 - double-check solutions + full playtest
 - remove debug stuff (anti-fade-in, "pass" keyword)
@@ -21,13 +23,8 @@ SOUND NOTEs:
 
 REFACTORS:
 - running average over frame timings display
-- write SSE2 versions of all blit routines
 - further SSE optimization of routines that are currently scalar
-- reduce massive code duplication of sprite blit routines with templates?
 - finish moving heavy draw ops into pixel.cpp
-
-BUGS:
-- many transparent sprites drawn on top of each other can result in visible darkening (possible blend func issue?)
 */
 
 #define GL_SILENCE_DEPRECATION
@@ -42,6 +39,9 @@ BUGS:
 #include "soloud_wav.h"
 #include "soloud_wavstream.h"
 #include "pixel.hpp"
+#include "draw_list.hpp"
+#include "post.hpp"
+#include "atlas.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// TERMINAL                                                                                                         ///
@@ -50,6 +50,7 @@ BUGS:
 struct Line {
     char * text;
     Image image;
+    Image strip; //`text` rendered by render_text_strip(), built the first time the line is drawn
 };
 
 struct Puzzle {
@@ -58,7 +59,7 @@ struct Puzzle {
 };
 
 //REMINDER: this hasn't been tested!
-List<Puzzle> parse_puzzles() {
+List<Puzzle> parse_puzzles(Atlas & atlas) {
     char * text = read_entire_file("res/puzzles.txt");
     List<char *> lines = split_non_empty_lines_in_place(text);
     List<Puzzle> puzzles = {};
@@ -71,7 +72,7 @@ List<Puzzle> parse_puzzles() {
                 consumingLines = true;
             } else if (consumingLines && !strcmp(token, "@image")) {
                 char * path = strtok(nullptr, "");
-                puzzles[puzzles.len - 1].prompt.add({ nullptr, load_image(path) });
+                puzzles[puzzles.len - 1].prompt.add({ nullptr, atlas_load_image(atlas, path) });
             } else {
                 consumingLines = false;
                 if (!strcmp(token, "@p2")) {
@@ -92,6 +93,106 @@ List<Puzzle> parse_puzzles() {
     return puzzles;
 }
 
+//a fixed-capacity ring of lines, whose text is stored in a ring arena instead of being allocated per line
+//when either runs out of room, the oldest lines are dropped to make space
+//NOTE: lines are indexed from oldest (0) to newest (count - 1)
+struct Scrollback {
+    Line * lines;
+    int * ends; //total height of all lines ever added, up to and including this one
+    int maxLines;
+    int first, count;
+    int added; //number of lines ever added, so callers can tell when the contents changed
+    int droppedHeight; //total height of all lines that have been dropped
+    int textHeight; //height of a line of text, as opposed to an image
+
+    char * arena;
+    int arenaSize;
+    int arenaHead; //where the next line's text goes
+};
+
+Scrollback make_scrollback(int maxLines, int arenaSize, int textHeight) {
+    Scrollback sb = {};
+    sb.lines = (Line *) calloc(maxLines, sizeof(Line));
+    sb.ends = (int *) calloc(maxLines, sizeof(int));
+    sb.maxLines = maxLines;
+    sb.textHeight = textHeight;
+    sb.arena = (char *) malloc(arenaSize);
+    sb.arenaSize = arenaSize;
+    return sb;
+}
+
+static inline Line & line_at(Scrollback & sb, int i) {
+    return sb.lines[(sb.first + i) % sb.maxLines];
+}
+
+//vertical offset of the top of line i from the top of the oldest line
+static inline int line_top(Scrollback & sb, int i) {
+    return (i? sb.ends[(sb.first + i - 1) % sb.maxLines] : sb.droppedHeight) - sb.droppedHeight;
+}
+
+static inline int content_height(Scrollback & sb) {
+    return line_top(sb, sb.count);
+}
+
+static void drop_oldest_line(Scrollback & sb) {
+    Line & line = sb.lines[sb.first];
+    free(line.strip.pixels);
+    sb.droppedHeight = sb.ends[sb.first];
+    line = {};
+    sb.first = (sb.first + 1) % sb.maxLines;
+    sb.count -= 1;
+}
+
+//finds room for `bytes` contiguous bytes of text, dropping old lines until there is some
+static char * alloc_text(Scrollback & sb, int bytes) {
+    assert(bytes <= sb.arenaSize / 2);
+    while (true) {
+        //the live text occupies [tail, head), possibly wrapped around the end of the arena
+        int tail = -1;
+        for (int i = 0; i < sb.count && tail < 0; ++i) {
+            if (line_at(sb, i).text) tail = line_at(sb, i).text - sb.arena;
+        }
+        if (tail < 0) {
+            sb.arenaHead = 0;
+            tail = 0;
+        }
+
+        if (sb.arenaHead >= tail) {
+            if (sb.arenaHead + bytes <= sb.arenaSize) break;
+            //wrap around, skipping the leftover space at the end
+            //NOTE: the comparisons are strict so that head == tail only ever means there is no live text
+            if (bytes < tail) {
+                sb.arenaHead = 0;
+                break;
+            }
+        } else if (sb.arenaHead + bytes < tail) {
+            break;
+        }
+        drop_oldest_line(sb);
+    }
+
+    char * text = sb.arena + sb.arenaHead;
+    sb.arenaHead += bytes;
+    return text;
+}
+
+//copies `text` (if any) into the arena, so the caller keeps ownership of its own string
+void add_line(Scrollback & sb, const char * text, Image image = {}) {
+    Line line = { nullptr, image };
+    if (text) {
+        int bytes = strlen(text) + 1;
+        line.text = (char *) memcpy(alloc_text(sb, bytes), text, bytes);
+    }
+
+    if (sb.count == sb.maxLines) drop_oldest_line(sb);
+    int top = sb.droppedHeight + content_height(sb);
+    int slot = (sb.first + sb.count) % sb.maxLines;
+    sb.lines[slot] = line;
+    sb.ends[slot] = top + (text? sb.textHeight : image.height);
+    sb.count += 1;
+    sb.added += 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// MAIN FUNCTION                                                                                                    ///
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -178,7 +279,36 @@ int main(int argc, char ** argv) {
     print_log("[] SDL create window: %f seconds\n", get_time());
         uint blitShader = create_program(read_entire_file("res/blit.vert"), read_entire_file("res/blit.frag"));
         Canvas canvas = make_canvas(canvasWidth, canvasHeight, 16);
+        CanvasPresenter presenter = make_canvas_presenter(blitShader, canvas);
+        DrawList scenes[2] = {}; //this frame's and last frame's, alternating
+        //every image the game draws is packed into one shared atlas
+        Atlas atlas = make_atlas();
         MonoFont font = load_mono_font("res/font-16-white.png", 8, 16);
+        atlas_add_font(atlas, font);
+
+        //pick the fastest blit backend this CPU supports, unless one was requested with `--blit=<name>`
+        BlitBackendType blitType = BLIT_AVX2;
+        for (int i = 1; i < argc; ++i) {
+            for (int b = 0; b < BLIT_BACKEND_COUNT; ++b) {
+                if (!strncmp(argv[i], "--blit=", 7) && !strcmp(argv[i] + 7, blitBackends[b].name)) {
+                    blitType = (BlitBackendType) b;
+                }
+            }
+        }
+        print_log("[] blit backend: %s\n", select_blit_backend(blitType)->name);
+
+        //EXPERIMENTAL: `--bloom` makes bright text glow onto its surroundings, and `--crt` curves the screen
+        //NOTE: both effects move pixels away from where they were drawn, so a change can show up anywhere,
+        //      which means they force the whole canvas to be redrawn every frame
+        bool bloomEnabled = false, crtEnabled = false;
+        for (int i = 1; i < argc; ++i) {
+            if (!strcmp(argv[i], "--bloom")) bloomEnabled = true;
+            if (!strcmp(argv[i], "--crt")) crtEnabled = true;
+        }
+        const float bloomSigma = 8;
+        Bloom bloom = bloomEnabled? make_bloom(canvasWidth, canvasHeight, bloomSigma) : Bloom {};
+        CrtWarp crt = make_crt_warp(0.08f, 0.3f, 0.4f);
+        Canvas crtCanvas = crtEnabled? make_canvas(canvasWidth, canvasHeight, 16) : Canvas {};
     print_log("[] graphics init: %f seconds\n", get_time());
         SoLoud::Soloud loud = {};
         if (int soloudError = loud.init(); soloudError) {
@@ -210,16 +340,15 @@ int main(int argc, char ** argv) {
         #define DOWN(X) (keyDown[SDL_SCANCODE_ ## X])
 
         const int gifCentiseconds = 5;
-        MsfGifState gifState = {};
+        MsfGifRecorder * gifRecorder = nullptr; //encodes and writes frames on background threads
         bool giffing = false;
         float gifTimer = 0;
 
         //graphics
-        Image background = load_image("res/term2.png");
+        Image background = atlas_load_image(atlas, "res/term2.png");
 
         //terminal data
         const int MAX_INPUT = 40;
-        List<Line> term = {};
         char input[MAX_INPUT + 1] = {};
         int upscroll = 0;
         float blinkTimer = 0;
@@ -231,16 +360,12 @@ int main(int argc, char ** argv) {
         int ty = 58;
         int tw = 33 * cw;
         int th = 16 * ch;
+        Scrollback term = make_scrollback(10000, 1 << 19, ch);
+        auto term_content_height = [&] () {
+            return content_height(term);
+        };
         auto total_term_height = [&] () {
-            int totalHeight = 0;
-            for (Line line : term) {
-                if (line.text) {
-                    totalHeight += ch;
-                } else {
-                    totalHeight += line.image.height;
-                }
-            }
-            return imax(th, totalHeight + ch);
+            return imax(th, term_content_height() + ch);
         };
 
         //HACK: punch a hole in the image where the terminal viewport is
@@ -249,9 +374,11 @@ int main(int argc, char ** argv) {
                 background[ty + y][tx + x] = {};
             }
         }
+        //the background is mostly opaque around that one big hole, so encode it as runs to skip the hole entirely
+        RunSprite backgroundRuns = make_run_sprite(background, true);
 
         //game progression
-        List<Puzzle> puzzles = parse_puzzles();
+        List<Puzzle> puzzles = parse_puzzles(atlas);
         int puzzleIdx = 0;
         int lineIdx = 0;
         float lineTimer = 0;
@@ -290,7 +417,9 @@ int main(int argc, char ** argv) {
                 }
 
                 if (event.type == SDL_KEYDOWN && scancode == SDL_SCANCODE_RETURN) {
-                    term.add({ dsprintf(nullptr, "> %s", input) });
+                    char echo[MAX_INPUT + 3];
+                    snprintf(echo, sizeof(echo), "> %s", input);
+                    add_line(term, echo);
                     upscroll = 0;
                     blinkTimer = 0;
 
@@ -339,12 +468,12 @@ int main(int argc, char ** argv) {
                     } else if (puzzleIdx < puzzles.len - 1) {
                         if (correct) {
                             ++puzzleIdx;
-                            term.add({ dup("") });
+                            add_line(term, "");
                             lineIdx = 0;
                             lineTimer = 0;
                             loud.play(sfx_right, 1.5f);
                         } else {
-                            term.add({ dup(" ERROR: incorrect input") });
+                            add_line(term, " ERROR: incorrect input");
                             loud.play(sfx_wrong, 0.25f);
                         }
                     }
@@ -384,7 +513,7 @@ int main(int argc, char ** argv) {
         float secondsPerLine = 0.025f;
         while (lineIdx < puzzles[puzzleIdx].prompt.len && lineTimer > secondsPerLine) {
             Line line = puzzles[puzzleIdx].prompt[lineIdx];
-            term.add({ dup(line.text), line.image });
+            add_line(term, line.text, line.image);
             ++lineIdx;
             lineTimer -= secondsPerLine;
         }
@@ -407,9 +536,11 @@ int main(int argc, char ** argv) {
                 giffing = !giffing;
                 if (giffing) {
                     gifTimer = 0;
-                    msf_gif_begin(&gifState, "out.gif", canvasWidth, canvasHeight);
+                    gifRecorder = msf_gif_recorder_begin("out.gif", canvasWidth, canvasHeight, 15, 2);
+                    giffing = gifRecorder != nullptr;
                 } else {
-                    msf_gif_end(&gifState);
+                    msf_gif_recorder_end(gifRecorder);
+                    gifRecorder = nullptr;
                 }
             }
 
@@ -451,97 +582,139 @@ int main(int argc, char ** argv) {
         glEnable(GL_MULTISAMPLE);
         glDisable(GL_CULL_FACE);
         glClear(GL_COLOR_BUFFER_BIT);
-        for (int y = 0; y < canvas.height; ++y) {
-            for (int x = 0; x < canvas.width; ++x) {
-                canvas[y][x] = { 33, 25, 25, 255 };
-            }
-        }
-
 
 
-        //DEBUG
-        // draw_rect(canvas, tx, ty, tw, th, { 0, 0, 0, 255 });
 
-        //draw background
-        if (lineIdx >= 120) {
-            draw_sprite_a1(canvas, background, 0, 0);
-        }
-
-        //draw terminal lines
-        // Color white = { 255, 255, 255, 255 };
-        Color white = { 166, 248, 136, 255 };
-        // Color white = { 83, 248, 68, 255 };
-        int cx = tx;
-        int cy = ty + th - total_term_height() + upscroll;
-        for (Line line : term) {
-            if (line.text) {
-                draw_text(canvas, font, cx, cy, white, line.text);
-                cy += ch;
-            } else {
-                draw_sprite(canvas, line.image, cx, cy);
-                cy += line.image.height;
-            }
-        }
+        //fade in sound
+        if (fadeInTimer > 3) fadeInTimer = 3;
+        float globalVolume = (fadeInTimer / 3) * 1.0f;
+        loud.setVolume(handle_bgloop, globalVolume);
+        loud.setVolume(handle_bgdrone, globalVolume);
 
-        //draw input line
-        draw_text(canvas, font, cx, cy, white, ">");
-        draw_text(canvas, font, cx + font.glyphWidth * 2, cy, white, input);
-        if (fmodf(blinkTimer * 1.5f, 2) < 1) {
-            draw_text(canvas, font, cx + font.glyphWidth * (2 + strlen(input)), cy - 2, white, "\x1F");
-            draw_text(canvas, font, cx + font.glyphWidth * (2 + strlen(input)), cy + 2, white, "\x1F");
+        // fadeInTimer = 3; //DEBUG
+        u8 blackOpacity = imin(255, (1 - fadeInTimer / 3) * 255);
+        bool endScreen = lineIdx == puzzles[puzzleIdx].prompt.len && lineIdx > 100;
+        if (endScreen && lineTimer > 5) {
+            exit(1);
         }
 
-        //draw background
-        if (lineIdx < 120) {
-            draw_sprite_a1(canvas, background, 0, 0);
-        }
+        int termTop = ty + th - total_term_height() + upscroll;
+        int inputY = termTop + term_content_height();
+        bool cursor = fmodf(blinkTimer * 1.5f, 2) < 1;
+        bool bgOnTop = lineIdx < 120;
 
-        auto draw_text_centered = [] (Canvas canvas, MonoFont font, int cx, int cy, Color color, const char * text) {
+        auto push_text_centered = [] (DrawList & list, MonoFont & font, int cx, int cy, Color color, const char * text) {
             int len = strlen(text);
             int x = cx - font.glyphWidth * len / 2;
             int y = cy - font.glyphHeight / 2;
-            draw_text(canvas, font, x, y, color, text);
+            push_text(list, font, x, y, color, text);
         };
 
-        //draw end screen
-        if (lineIdx == puzzles[puzzleIdx].prompt.len && lineIdx > 100) {
-            Color green = { 83, 248, 68, 255 };
-            Color black = { 0, 0, 0, 255 };
-            draw_rect(canvas, 0, 0, canvasWidth, canvasHeight, green);
-            draw_text_centered(canvas, font, canvasWidth / 2, canvasHeight / 2 - ch / 2, black, "WELCOME TO THE DIGITAL");
+        //record the scene, diff it against last frame's to find what changed,
+        //then redraw each changed region from scratch by replaying the scene clipped to that region
+        DrawList & scene = scenes[frameCount % 2];
+        DrawList & lastScene = scenes[(frameCount + 1) % 2];
+        clear_draw_list(scene);
+        {
+            push_fill_rect(scene, 0, 0, canvas.width, canvas.height, { 33, 25, 25, 255 });
+
+            //DEBUG
+            // push_rect(scene, tx, ty, tw, th, { 0, 0, 0, 255 });
 
-            if (lineTimer > 5) {
-                exit(1);
+            //draw background
+            if (!bgOnTop) {
+                push_run_sprite(scene, backgroundRuns, 0, 0);
             }
-        }
 
+            //draw terminal lines
+            // Color white = { 255, 255, 255, 255 };
+            Color white = { 166, 248, 136, 255 };
+            // Color white = { 83, 248, 68, 255 };
+            //only draw lines that are on the canvas, finding the first one by binary search
+            //NOTE: text lines draw a little past their height, because descenders extend below the line spacing
+            int overhang = imax(0, font.glyphHeight * 2 - ch);
+            int first = 0, last = term.count;
+            while (first < last) {
+                int mid = (first + last) / 2;
+                if (termTop + line_top(term, mid + 1) + overhang <= 0) {
+                    first = mid + 1;
+                } else {
+                    last = mid;
+                }
+            }
+            int cx = tx;
+            for (int i = first; i < term.count; ++i) {
+                Line & line = line_at(term, i);
+                int cy = termTop + line_top(term, i);
+                if (cy >= canvas.height) break;
+                if (line.text) {
+                    if (!line.strip.pixels) line.strip = render_text_strip(font, white, line.text);
+                    push_text_strip(scene, line.strip, cx, cy);
+                } else {
+                    push_sprite(scene, line.image, cx, cy);
+                }
+            }
+            int cy = inputY;
+
+            //draw input line
+            push_text(scene, font, cx, cy, white, ">");
+            push_text(scene, font, cx + font.glyphWidth * 2, cy, white, input);
+            if (cursor) {
+                push_text(scene, font, cx + font.glyphWidth * (2 + strlen(input)), cy - 2, white, "\x1F");
+                push_text(scene, font, cx + font.glyphWidth * (2 + strlen(input)), cy + 2, white, "\x1F");
+            }
 
+            //draw background
+            if (bgOnTop) {
+                push_run_sprite(scene, backgroundRuns, 0, 0);
+            }
 
-        //fade in sound
-        if (fadeInTimer > 3) fadeInTimer = 3;
-        float globalVolume = (fadeInTimer / 3) * 1.0f;
-        loud.setVolume(handle_bgloop, globalVolume);
-        loud.setVolume(handle_bgdrone, globalVolume);
+            //draw end screen
+            if (endScreen) {
+                Color green = { 83, 248, 68, 255 };
+                Color black = { 0, 0, 0, 255 };
+                push_rect(scene, 0, 0, canvasWidth, canvasHeight, green);
+                push_text_centered(scene, font, canvasWidth / 2, canvasHeight / 2 - ch / 2, black,
+                    "WELCOME TO THE DIGITAL");
+            }
 
-        //apply fullscreen fade-in overlay
-        // fadeInTimer = 3; //DEBUG
-        u8 blackOpacity = imin(255, (1 - fadeInTimer / 3) * 255);
-        draw_rect(canvas, 0, 0, canvas.width, canvas.height, { 0, 0, 0, blackOpacity });
+            //apply fullscreen fade-in overlay
+            push_rect(scene, 0, 0, canvas.width, canvas.height, { 0, 0, 0, blackOpacity });
+        }
+        diff_draw_lists(canvas, scene, lastScene);
+        if (bloomEnabled || crtEnabled) mark_dirty(canvas, bounds(0, 0, canvas.width, canvas.height));
+        DirtyList redraw = *canvas.dirty;
+        render_draw_list(canvas, scene, redraw.rects, redraw.count);
+        if (bloomEnabled) apply_bloom(canvas, bloom, 128, bloomSigma, 0.6f);
+
+        //from here on, everything goes to whichever canvas actually gets shown
+        Canvas & output = crtEnabled? crtCanvas : canvas;
+        if (crtEnabled) {
+            apply_crt_warp(crt, crtCanvas, canvas);
+            mark_dirty(crtCanvas, bounds(0, 0, crtCanvas.width, crtCanvas.height));
+        }
 
         if (giffing && gifTimer > gifCentiseconds / 100.0f) {
-            msf_gif_frame(&gifState, (uint8_t *) canvas.pixels, canvas.pitch * 4, gifCentiseconds, 15, false);
+            msf_gif_recorder_frame(gifRecorder, (uint8_t *) output.pixels, output.pitch * 4, gifCentiseconds, false);
             gifTimer -= gifCentiseconds / 100.0f;
         }
 
         if (giffing) {
-            draw_text(canvas, font, 2, 2, { 255, 255, 255, 100 }, "GIF");
+            draw_text(output, font, 2, 2, { 255, 255, 255, 100 }, "GIF");
         }
 
         // char buffer[256];
         // snprintf(buffer, sizeof(buffer), "%4.1f ms", (get_time() - preFrame) * 1000);
         // draw_text(canvas, font, canvas.width - 80, 2, { 255, 255, 255, 100 }, buffer);
 
-        draw_canvas(blitShader, canvas, bufferWidth, bufferHeight);
+        draw_canvas(presenter, output, bufferWidth, bufferHeight);
+        clear_dirty(canvas);
+        clear_dirty(output);
+
+        //the GIF label isn't part of the scene, so next frame has to paint over it
+        if (giffing) {
+            mark_dirty(canvas, bounds(2, 2, font.glyphWidth * 3, font.glyphHeight * 2));
+        }
 
         gl_error("after everything");
         SDL_GL_SwapWindow(window);